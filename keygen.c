@@ -9,28 +9,69 @@
  **              randomization methods. The last character keygen outputs  *
  **              should be a newline. All error text must be output to     *
  **              stderr.                                                   *
+ **                                                                        *
+ **              With -a, the characters are taken from another alphabet   *
+ **              instead (see otp_kernel.h), such as base32 or print.      *
+ **                                                                        *
+ **              With -s, keygen writes a seed instead of a key: the       *
+ **              OTP_SEED_SIZE random bytes of a ChaCha20 key and nonce,   *
+ **              from which the daemons derive a key of any length (see    *
+ **              otp_enc -s). Like a key, a seed is good for one message.  *
+ **                                                                        *
+ **              With -b, keygen writes keyLength random bytes instead,    *
+ **              taken from /dev/urandom and without the newline, for the  *
+ **              binary (XOR) mode of otp_enc and otp_dec.                 *
  **************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "otp_kernel.h"
+#include "otp_proto.h"
+
+#define BUFFERSIZE 65536
 
 // Function Prototype.
 int randInt(int min, int max);
+int binaryKey(int keyLength);
 
 int main(int argc, char *argv[]) {
 
     // Declare variables.
     int i, keyLength;
+    int binary = 0;
     time_t sysClock;
     char randLetter;
+    const struct otp_alphabet *alphabet = otp_alphabet(OTP_MODE_TEXT);
 
+    // -s makes a seed, whatever the length of the message.
+    if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+        return binaryKey(OTP_SEED_SIZE);
+    }
+    // -b selects a binary key, -a the alphabet of a text key.
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+        binary = 1;
+        argv++;
+        argc--;
+    } else if (argc > 2 && strcmp(argv[1], "-a") == 0) {
+        alphabet = otp_alphabet_named(argv[2]);
+        if (alphabet == NULL) {
+            fprintf(stderr, "keygen: unknown alphabet %s\n", argv[2]);
+            exit(1);
+        }
+        argv += 2;
+        argc -= 2;
+    }
     // Check if there are enough arguments.
     if (argc < 2) {
-        printf("Usage: keygen keyLength\n");
+        printf("Usage: keygen [-b | -a alphabet] keyLength, or keygen -s\n");
         exit(1);
     }
     // Get the same length as the plaintext for the key file.
+    keyLength = 0;
     sscanf(argv[1], "%d", &keyLength);
 
     // Error checking.
@@ -38,6 +79,9 @@ int main(int argc, char *argv[]) {
         printf("keygen: invalid keyLength\n");
         exit(1);
     }
+    if (binary) {
+        return binaryKey(keyLength);
+    }
     // Seed random number generator.
     srand((unsigned) time(&sysClock));
 
@@ -45,12 +89,7 @@ int main(int argc, char *argv[]) {
     for (i = 0; i < keyLength; i++) {
         
         // Call function to produce random letters.
-        randLetter = (char) randInt(64, 90);
-
-        // Space case.
-        if (randLetter == '@') {
-           randLetter = ' ';
-        }
+        randLetter = alphabet->symbols[randInt(0, alphabet->size - 1)];
         printf("%c", randLetter);
     }
     printf("\n");
@@ -64,3 +103,29 @@ int main(int argc, char *argv[]) {
 int randInt(int min, int max) {
     return rand() % (max - min + 1) + min;
 }
+
+/*******************************************************
+ * binaryKey(): Function to write keyLength random     *
+ *              bytes to stdout.                       *
+ ******************************************************/
+int binaryKey(int keyLength) {
+    char buffer[BUFFERSIZE];
+    size_t length;
+    FILE *random = fopen("/dev/urandom", "rb");
+
+    if (random == NULL) {
+        fprintf(stderr, "keygen: cannot open /dev/urandom\n");
+        return 1;
+    }
+    while (keyLength > 0) {
+        length = keyLength < BUFFERSIZE ? keyLength : BUFFERSIZE;
+        if (fread(buffer, 1, length, random) != length) {
+            fprintf(stderr, "keygen: cannot read /dev/urandom\n");
+            return 1;
+        }
+        fwrite(buffer, 1, length, stdout);
+        keyLength -= length;
+    }
+    fclose(random);
+    return 0;
+}
@@ -0,0 +1,129 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_bufpool.c                                             *
+ **                                                                        *
+ ** Description: Size-classed buffer pool (see otp_bufpool.h). Each        *
+ **              worker process has its own pool, so no locking is needed. *
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "otp_bufpool.h"
+#include "otp_proto.h"
+
+// Number of size classes between OTP_BUF_MIN and OTP_CHUNK.
+#define NUM_CLASSES 8
+
+// A buffer sitting on a free list.
+struct freeBuffer {
+    struct freeBuffer *next;
+};
+
+static struct freeBuffer *freeList[NUM_CLASSES];
+static char *slab = NULL;           // slab buffers are carved from.
+static size_t slabUsed = 0;         // bytes of the slab handed out.
+static int useHugePages = 0;
+
+/*******************************************************
+ * otp_buf_hugepages(): Back the slabs allocated from  *
+ *                      now on with huge pages.        *
+ ******************************************************/
+void otp_buf_hugepages(int enable) {
+    useHugePages = enable;
+}
+
+/*******************************************************
+ * sizeClass(): Return the class of a buffer of size   *
+ *              bytes, or -1 if it's too big for the   *
+ *              pool.                                  *
+ ******************************************************/
+static int sizeClass(size_t size) {
+    size_t classSize = OTP_BUF_MIN;
+    int class = 0;
+
+    while (classSize < size) {
+        classSize <<= 1;
+        class++;
+    }
+    return class < NUM_CLASSES ? class : -1;
+}
+
+/*******************************************************
+ * newSlab(): Map a new slab, with huge pages if asked *
+ *            to and if the system has any.            *
+ ******************************************************/
+static char *newSlab(void) {
+    void *memory = MAP_FAILED;
+
+    if (useHugePages) {
+        memory = mmap(NULL, OTP_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (memory == MAP_FAILED) {
+        memory = mmap(NULL, OTP_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return NULL;
+        }
+        // Fall back on transparent huge pages.
+        if (useHugePages) {
+            madvise(memory, OTP_SLAB_SIZE, MADV_HUGEPAGE);
+        }
+    }
+    return memory;
+}
+
+/*******************************************************
+ * otp_buf_get(): Get a buffer of at least size bytes. *
+ *                Returns NULL when out of memory.     *
+ ******************************************************/
+char *otp_buf_get(size_t size) {
+    int class = sizeClass(size);
+    size_t classSize;
+    char *buf;
+
+    // Too big for the pool.
+    if (class < 0) {
+        return malloc(size);
+    }
+    // Reuse a warm buffer of the same class.
+    if (freeList[class] != NULL) {
+        buf = (char *) freeList[class];
+        freeList[class] = freeList[class]->next;
+        return buf;
+    }
+    // Otherwise carve a new one out of the slab.
+    classSize = (size_t) OTP_BUF_MIN << class;
+    if (slab == NULL || slabUsed + classSize > OTP_SLAB_SIZE) {
+        slab = newSlab();
+        slabUsed = 0;
+        if (slab == NULL) {
+            return NULL;
+        }
+    }
+    buf = slab + slabUsed;
+    slabUsed += classSize;
+    return buf;
+}
+
+/*******************************************************
+ * otp_buf_put(): Give back a buffer obtained from     *
+ *                otp_buf_get() with the same size.    *
+ ******************************************************/
+void otp_buf_put(char *buf, size_t size) {
+    int class = sizeClass(size);
+    struct freeBuffer *entry = (struct freeBuffer *) buf;
+
+    if (buf == NULL) {
+        return;
+    }
+    if (class < 0) {
+        free(buf);
+        return;
+    }
+    entry->next = freeList[class];
+    freeList[class] = entry;
+}
@@ -0,0 +1,32 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_bufpool.h                                             *
+ **                                                                        *
+ ** Description: Size-classed buffer pool for the daemon workers. Buffers  *
+ **              come in powers of two from OTP_BUF_MIN up to OTP_CHUNK    *
+ **              bytes and are carved out of 2 MB slabs, so a 10 byte      *
+ **              message only touches a few hundred bytes of memory        *
+ **              instead of three 100 KB stack buffers. Buffers given back *
+ **              are kept on a free list per class and handed out again    *
+ **              to the next request of the same worker while they are     *
+ **              still warm in the cache. Slabs can be backed by huge      *
+ **              pages to cut page faults and TLB misses on big payloads.  *
+ **************************************************************************/
+
+#ifndef OTP_BUFPOOL_H
+#define OTP_BUFPOOL_H
+
+#include <stddef.h>
+
+// Smallest buffer handed out.
+#define OTP_BUF_MIN 512
+
+// Memory carved into buffers at a time.
+#define OTP_SLAB_SIZE (2 * 1024 * 1024)
+
+void otp_buf_hugepages(int enable);
+char *otp_buf_get(size_t size);
+void otp_buf_put(char *buf, size_t size);
+
+#endif
@@ -0,0 +1,178 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_capture.c                                             *
+ **                                                                        *
+ ** Description: Traffic capture (see otp_capture.h). The parent opens the *
+ **              log and stamps every connection it accepts; the worker    *
+ **              forked for it times its requests and appends them.        *
+ **************************************************************************/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "otp_capture.h"
+
+static int logFd = -1;              // the log, or -1 when not capturing.
+static int withPayloads = 0;        // log the chunks too.
+static uint64_t connTime = 0;       // when this connection was accepted.
+static uint64_t lastConnTime = 0;   // same for the last one, in the parent.
+
+// Request being served.
+static int pending = 0;
+static struct otp_capture_request record;
+static uint64_t started;            // monotonic time it arrived.
+static uint64_t processed;          // bytes of text seen so far.
+
+/*******************************************************
+ * nowNs(): Time of the given clock in nanoseconds.    *
+ ******************************************************/
+static uint64_t nowNs(clockid_t clock) {
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*******************************************************
+ * pack(): Store a 64-bit value as two 32-bit fields   *
+ *         in network byte order.                      *
+ ******************************************************/
+static void pack(uint32_t *high, uint32_t *low, uint64_t value) {
+    *high = htonl((uint32_t) (value >> 32));
+    *low = htonl((uint32_t) value);
+}
+
+/*******************************************************
+ * otp_capture_enable(): Open the log at path, and     *
+ *                       start it unless it is there   *
+ *                       already. It must be called    *
+ *                       before the workers are        *
+ *                       forked. Returns -1 on failure *
+ *                       or when the log was started   *
+ *                       by another kind of daemon.    *
+ ******************************************************/
+int otp_capture_enable(const char *path, int payloads, const char *client) {
+    struct otp_capture_header header;
+    struct otp_capture_header existing;
+    struct stat info;
+
+    logFd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (logFd < 0 || fstat(logFd, &info) < 0) {
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, OTP_CAPTURE_MAGIC, sizeof(header.magic));
+    strncpy(header.client, client, sizeof(header.client) - 1);
+    header.flags = htonl(payloads ? OTP_CAPTURE_PAYLOADS : 0);
+
+    if (info.st_size == 0) {
+        if (otp_write_full(logFd, &header, sizeof(header)) < 0) {
+            close(logFd);
+            logFd = -1;
+            return -1;
+        }
+    } else {
+        // Append only to a log of the same kind.
+        if (pread(logFd, &existing, sizeof(existing), 0) != sizeof(existing)
+                || memcmp(&existing, &header, sizeof(header)) != 0) {
+            close(logFd);
+            logFd = -1;
+            return -1;
+        }
+    }
+    withPayloads = payloads;
+    return 0;
+}
+
+/*******************************************************
+ * otp_capture_accept(): Stamp a connection just       *
+ *                       accepted. Called by the       *
+ *                       parent before it forks the    *
+ *                       worker. The time identifies   *
+ *                       the connection in the log, so *
+ *                       no two get the same.          *
+ ******************************************************/
+void otp_capture_accept(void) {
+    if (logFd < 0) {
+        return;
+    }
+    connTime = nowNs(CLOCK_REALTIME);
+    if (connTime <= lastConnTime) {
+        connTime = lastConnTime + 1;
+    }
+    lastConnTime = connTime;
+}
+
+/*******************************************************
+ * otp_capture_begin(): Start timing a request whose   *
+ *                      header just arrived.           *
+ ******************************************************/
+void otp_capture_begin(uint32_t mode, uint32_t flags, uint64_t length) {
+    if (logFd < 0) {
+        return;
+    }
+    memset(&record, 0, sizeof(record));
+    record.kind = htonl(OTP_CAPTURE_REQUEST);
+    record.mode = htonl(mode);
+    record.flags = htonl(flags);
+    pack(&record.connHigh, &record.connLow, connTime);
+    pack(&record.startHigh, &record.startLow, nowNs(CLOCK_REALTIME));
+    pack(&record.lengthHigh, &record.lengthLow, length);
+
+    started = nowNs(CLOCK_MONOTONIC);
+    processed = 0;
+    pending = 1;
+}
+
+/*******************************************************
+ * otp_capture_chunk(): Count a chunk of length bytes  *
+ *                      of the request, and log its    *
+ *                      text and key (if not NULL)     *
+ *                      with -C.                       *
+ ******************************************************/
+void otp_capture_chunk(const char *text, const char *key, size_t length) {
+    struct otp_capture_chunk chunk;
+    struct iovec iov[3];
+
+    if (!pending) {
+        return;
+    }
+    processed += length;
+    if (!withPayloads) {
+        return;
+    }
+    chunk.kind = htonl(OTP_CAPTURE_CHUNK);
+    pack(&chunk.connHigh, &chunk.connLow, connTime);
+    chunk.textLength = htonl(length);
+    chunk.keyLength = htonl(key != NULL ? length : 0);
+
+    iov[0].iov_base = &chunk;
+    iov[0].iov_len = sizeof(chunk);
+    iov[1].iov_base = (void *) text;
+    iov[1].iov_len = length;
+    iov[2].iov_base = (void *) key;
+    iov[2].iov_len = key != NULL ? length : 0;
+    writev(logFd, iov, 3);
+}
+
+/*******************************************************
+ * otp_capture_end(): Log the request being served,    *
+ *                    now that it ended with status.   *
+ ******************************************************/
+void otp_capture_end(unsigned char status) {
+    if (!pending) {
+        return;
+    }
+    pending = 0;
+    record.status = htonl(status);
+    pack(&record.latencyHigh, &record.latencyLow, nowNs(CLOCK_MONOTONIC) - started);
+    pack(&record.bytesHigh, &record.bytesLow, processed);
+    write(logFd, &record, sizeof(record));
+}
@@ -0,0 +1,90 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_capture.h                                             *
+ **                                                                        *
+ ** Description: Traffic capture for the daemons (opt-in with -c or -C).   *
+ **              Every request served is appended to a binary log: when    *
+ **              its connection was accepted, when its header arrived, how *
+ **              long it took until the answer was written, its mode,      *
+ **              flags, declared length, the bytes actually processed and  *
+ **              the status it ended with. With -C, the text and key of    *
+ **              every chunk are logged too, ahead of their request. Seeds *
+ **              are never logged. otp_replay plays a log back against a   *
+ **              daemon and compares the latencies.                        *
+ **                                                                        *
+ **              The log starts with a struct otp_capture_header, then the *
+ **              records follow, each one written with a single write() to *
+ **              the file opened with O_APPEND, so the workers never mix   *
+ **              them up. Every field travels in network byte order, so a  *
+ **              log can be replayed on another host. A daemon restarted   *
+ **              on the same log (or upgraded with SIGHUP) appends to it.  *
+ **                                                                        *
+ **              The payloads hold the keys: a log made with -C is as      *
+ **              secret as the pads that went through the daemon.          *
+ **************************************************************************/
+
+#ifndef OTP_CAPTURE_H
+#define OTP_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "otp_proto.h"
+
+// First bytes of a log.
+#define OTP_CAPTURE_MAGIC "OTPCAP01"
+
+// Header flags.
+#define OTP_CAPTURE_PAYLOADS 1  // the chunks are logged.
+
+// Record kinds.
+#define OTP_CAPTURE_REQUEST 1
+#define OTP_CAPTURE_CHUNK 2
+
+// Status of a request whose connection failed before it was answered.
+#define OTP_CAPTURE_DROPPED 0xff
+
+// Start of the log.
+struct otp_capture_header {
+    char magic[8];              // OTP_CAPTURE_MAGIC.
+    char client[OTP_NAME_MAX];  // handshake of the clients ("enc_bs" or "dec_bs").
+    uint32_t flags;             // OTP_CAPTURE_* flags.
+};
+
+// One request. Times are in nanoseconds, since the epoch for the
+// connection and the arrival.
+struct otp_capture_request {
+    uint32_t kind;              // OTP_CAPTURE_REQUEST.
+    uint32_t mode;
+    uint32_t flags;             // OTP_FLAG_* bits.
+    uint32_t status;            // last status sent, or OTP_CAPTURE_DROPPED.
+    uint32_t connHigh;          // connection accepted.
+    uint32_t connLow;
+    uint32_t startHigh;         // header received.
+    uint32_t startLow;
+    uint32_t latencyHigh;       // from then until the answer was written.
+    uint32_t latencyLow;
+    uint32_t lengthHigh;        // declared length.
+    uint32_t lengthLow;
+    uint32_t bytesHigh;         // bytes of text processed.
+    uint32_t bytesLow;
+};
+
+// One chunk of the next request on the same connection, followed
+// by textLength bytes of text and keyLength bytes of key.
+struct otp_capture_chunk {
+    uint32_t kind;              // OTP_CAPTURE_CHUNK.
+    uint32_t connHigh;
+    uint32_t connLow;
+    uint32_t textLength;
+    uint32_t keyLength;         // 0 when the key comes from a seed.
+};
+
+int otp_capture_enable(const char *path, int payloads, const char *client);
+void otp_capture_accept(void);
+void otp_capture_begin(uint32_t mode, uint32_t flags, uint64_t length);
+void otp_capture_chunk(const char *text, const char *key, size_t length);
+void otp_capture_end(unsigned char status);
+
+#endif
@@ -0,0 +1,1040 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_client.c                                              *
+ **                                                                        *
+ ** Description: libotpclient (see otp_client.h). The code was factored    *
+ **              out of otp_enc.c and otp_dec.c.                           *
+ **************************************************************************/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "otp_client.h"
+#include "otp_kernel.h"
+#include "otp_proto.h"
+
+// Handshake strings sent and expected for each daemon.
+static const char *clientName[2] = {"enc_bs", "dec_bs"};
+static const char *daemonName[2] = {"enc_d_bs", "dec_d_bs"};
+
+/*******************************************************
+ * resolve(): Look up the address of the daemon.       *
+ ******************************************************/
+static struct addrinfo *resolve(const char *host, int port) {
+    struct addrinfo hints, *addrs;
+    char service[16];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+
+    if (getaddrinfo(host, service, &hints, &addrs) != 0) {
+        return NULL;
+    }
+    return addrs;
+}
+
+/*******************************************************
+ * handshake(): Introduce ourselves to the daemon on a *
+ *              new connection. Returns sockfd, or an  *
+ *              error once the socket is closed.       *
+ ******************************************************/
+static int handshake(int sockfd, int which) {
+    char reply[OTP_NAME_MAX];
+    struct iovec iov;
+
+    iov.iov_base = (char *) clientName[which];
+    iov.iov_len = strlen(clientName[which]) + 1;
+
+    // Make sure otp_enc is NOT able to connect to otp_dec_d and vice versa.
+    if (otp_writev_full(sockfd, &iov, 1) < 0 || otp_read_string(sockfd, reply, sizeof(reply)) < 0) {
+        close(sockfd);
+        return OTP_E_CONNECT;
+    }
+    if (strcmp(reply, daemonName[which]) != 0) {
+        close(sockfd);
+        return OTP_E_REJECTED;
+    }
+    return sockfd;
+}
+
+/*******************************************************
+ * connectAddrs(): Connect to the first address that   *
+ *                 answers and do the handshake.       *
+ ******************************************************/
+static int connectAddrs(struct addrinfo *addrs, int which) {
+    struct addrinfo *addr;
+    int value = 1;
+    int sockfd = -1;
+
+    for (addr = addrs; addr != NULL; addr = addr->ai_next) {
+        sockfd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (sockfd < 0) {
+            continue;
+        }
+        if (connect(sockfd, addr->ai_addr, addr->ai_addrlen) == 0) {
+            break;
+        }
+        close(sockfd);
+        sockfd = -1;
+    }
+    if (sockfd < 0) {
+        return OTP_E_CONNECT;
+    }
+    // Requests are small writes followed by a wait for the answer.
+    setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+
+    return handshake(sockfd, which);
+}
+
+/*******************************************************
+ * otp_connect(): Connect to the daemon on host:port   *
+ *                and do the handshake.                *
+ ******************************************************/
+int otp_connect(const char *host, int port, int which) {
+    struct addrinfo *addrs = resolve(host, port);
+    int sockfd;
+
+    if (addrs == NULL) {
+        return OTP_E_CONNECT;
+    }
+    sockfd = connectAddrs(addrs, which);
+    freeaddrinfo(addrs);
+    return sockfd;
+}
+
+/*******************************************************
+ * otp_connect_unix(): Connect to the daemon listening *
+ *                     on the Unix-domain socket path  *
+ *                     and do the handshake.           *
+ ******************************************************/
+int otp_connect_unix(const char *path, int which) {
+    struct sockaddr_un addr;
+    int sockfd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return OTP_E_CONNECT;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        return OTP_E_CONNECT;
+    }
+    if (connect(sockfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        close(sockfd);
+        return OTP_E_CONNECT;
+    }
+    return handshake(sockfd, which);
+}
+
+/*******************************************************
+ * statusError(): Turn a status byte other than OTP_OK *
+ *                into an OTP_E_* error code.          *
+ ******************************************************/
+static int statusError(unsigned char status) {
+    switch (status) {
+    case OTP_BAD_TEXT:
+        return OTP_E_TEXT;
+    case OTP_BAD_KEY:
+        return OTP_E_KEY;
+    case OTP_BAD_REQUEST:
+        return OTP_E_MODE;
+    case OTP_SHORT_KEY:
+        return OTP_E_SHORTKEY;
+    case OTP_BAD_FILE:
+        return OTP_E_FILE;
+    }
+    return OTP_E_IO;
+}
+
+/*******************************************************
+ * checkInput(): Check the text and the key of a job   *
+ *               (a seed with OTP_SEEDED) before       *
+ *               anything is sent. Returns 0 or the    *
+ *               error code.                           *
+ ******************************************************/
+static int checkInput(int flags, const char *buf, size_t len, const char *key, size_t keylen) {
+    uint32_t mode = flags & OTP_MODE_FLAGS;
+    const struct otp_alphabet *alphabet = otp_alphabet(mode);
+
+    if ((flags & OTP_SEEDED) && keylen != OTP_SEED_SIZE) {
+        return OTP_E_KEY;
+    }
+    if (!(flags & OTP_SEEDED) && keylen < len) {
+        return OTP_E_SHORTKEY;
+    }
+    // Any byte goes in binary mode.
+    if (mode == OTP_MODE_BINARY) {
+        return 0;
+    }
+    if (alphabet == NULL) {
+        return OTP_E_MODE;
+    }
+    if (!otp_valid_text(alphabet, buf, len)) {
+        return OTP_E_TEXT;
+    }
+    if (!(flags & OTP_SEEDED) && !otp_valid_text(alphabet, key, len)) {
+        return OTP_E_KEY;
+    }
+    return 0;
+}
+
+/*******************************************************
+ * packSeed(): Fill in the struct otp_seed of a request *
+ *             starting at position in the key.         *
+ ******************************************************/
+static void packSeed(struct otp_seed *message, const char *seed, uint64_t position) {
+    memcpy(message->seed, seed, sizeof(message->seed));
+    message->offsetHigh = htonl((uint32_t) (position >> 32));
+    message->offsetLow = htonl((uint32_t) position);
+}
+
+/*******************************************************
+ * transfer(): Run one request on the connection. The  *
+ *             daemon decides whether it's encryption  *
+ *             or decryption.                          *
+ ******************************************************/
+static int transfer(int sockfd, uint32_t mode, const char *buf, size_t len,
+                    const char *key, size_t keylen, char *out) {
+    struct iovec iov[2];
+    size_t offset, length;
+    unsigned char status;
+    int result;
+
+    result = checkInput(mode, buf, len, key, keylen);
+    if (result < 0) {
+        return result;
+    }
+    if (otp_send_request(sockfd, mode, len) < 0) {
+        return OTP_E_IO;
+    }
+    // Send every chunk of text with its key and read the answer back.
+    for (offset = 0; offset < len; offset += length) {
+        length = len - offset < OTP_CHUNK ? len - offset : OTP_CHUNK;
+
+        iov[0].iov_base = (char *) buf + offset;
+        iov[0].iov_len = length;
+        iov[1].iov_base = (char *) key + offset;
+        iov[1].iov_len = length;
+        if (otp_writev_full(sockfd, iov, 2) < 0) {
+            return OTP_E_IO;
+        }
+        if (otp_read_full(sockfd, &status, 1) != 1) {
+            return OTP_E_IO;
+        }
+        if (status != OTP_OK) {
+            return statusError(status);
+        }
+        if (otp_read_full(sockfd, out + offset, length) != (ssize_t) length) {
+            return OTP_E_IO;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************
+ * otp_encrypt(): Encrypt len bytes of buf with key    *
+ *                into out, over a connection to       *
+ *                otp_enc_d.                           *
+ ******************************************************/
+int otp_encrypt(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out) {
+    return transfer(sockfd, OTP_MODE_TEXT, buf, len, key, keylen, out);
+}
+
+/*******************************************************
+ * otp_decrypt(): Decrypt len bytes of buf with key    *
+ *                into out, over a connection to       *
+ *                otp_dec_d.                           *
+ ******************************************************/
+int otp_decrypt(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out) {
+    return transfer(sockfd, OTP_MODE_TEXT, buf, len, key, keylen, out);
+}
+
+/*******************************************************
+ * otp_encrypt_bytes(): Encrypt len arbitrary bytes    *
+ *                      with a binary key, over a      *
+ *                      connection to otp_enc_d.       *
+ ******************************************************/
+int otp_encrypt_bytes(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out) {
+    return transfer(sockfd, OTP_MODE_BINARY, buf, len, key, keylen, out);
+}
+
+/*******************************************************
+ * otp_decrypt_bytes(): Decrypt len bytes encrypted    *
+ *                      with otp_encrypt_bytes(), over *
+ *                      a connection to otp_dec_d.     *
+ ******************************************************/
+int otp_decrypt_bytes(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out) {
+    return transfer(sockfd, OTP_MODE_BINARY, buf, len, key, keylen, out);
+}
+
+/*******************************************************
+ * transferFiles(): Run one request on a Unix-domain   *
+ *                  connection by passing the files    *
+ *                  themselves. The daemon reads the   *
+ *                  first len bytes of textfd and      *
+ *                  keyfd and writes the result to     *
+ *                  outfd.                             *
+ ******************************************************/
+static int transferFiles(int sockfd, int flags, int textfd, size_t len,
+                         int keyfd, size_t keylen, int outfd) {
+    uint32_t mode = flags & OTP_MODE_FLAGS;
+    struct otp_seed message;
+    char seed[OTP_SEED_SIZE];
+    int fds[OTP_MAX_FDS];
+    unsigned char status;
+
+    if (!(flags & OTP_SEEDED)) {
+        if (keylen < len) {
+            return OTP_E_SHORTKEY;
+        }
+        fds[0] = textfd;
+        fds[1] = keyfd;
+        fds[2] = outfd;
+
+        if (otp_send_request_fds(sockfd, mode, OTP_FLAG_FILES, len, fds, OTP_MAX_FDS) < 0) {
+            return OTP_E_IO;
+        }
+    } else {
+        // The seed is sent instead of the key file.
+        if (keylen != OTP_SEED_SIZE || pread(keyfd, seed, sizeof(seed), 0) != sizeof(seed)) {
+            return OTP_E_KEY;
+        }
+        packSeed(&message, seed, 0);
+        fds[0] = textfd;
+        fds[1] = outfd;
+
+        if (otp_send_request_fds(sockfd, mode, OTP_FLAG_FILES | OTP_FLAG_SEED, len, fds,
+                                 OTP_MAX_FDS - 1) < 0
+                || otp_write_full(sockfd, &message, sizeof(message)) < 0) {
+            return OTP_E_IO;
+        }
+    }
+    if (otp_read_full(sockfd, &status, 1) != 1) {
+        return OTP_E_IO;
+    }
+    return status == OTP_OK ? 0 : statusError(status);
+}
+
+/*******************************************************
+ * otp_encrypt_files(): Encrypt the first len bytes of *
+ *                      textfd with keyfd into outfd,  *
+ *                      over a Unix-domain connection  *
+ *                      to otp_enc_d. The text and the *
+ *                      key must be regular files.     *
+ ******************************************************/
+int otp_encrypt_files(int sockfd, int flags, int textfd, size_t len,
+                      int keyfd, size_t keylen, int outfd) {
+    return transferFiles(sockfd, flags, textfd, len, keyfd, keylen, outfd);
+}
+
+/*******************************************************
+ * otp_decrypt_files(): Decrypt the first len bytes of *
+ *                      textfd with keyfd into outfd,  *
+ *                      over a Unix-domain connection  *
+ *                      to otp_dec_d.                  *
+ ******************************************************/
+int otp_decrypt_files(int sockfd, int flags, int textfd, size_t len,
+                      int keyfd, size_t keylen, int outfd) {
+    return transferFiles(sockfd, flags, textfd, len, keyfd, keylen, outfd);
+}
+
+/*******************************************************
+ * runJob(): Run a resumable job on the connection, or *
+ *           resume it when *id is set. *offset and    *
+ *           *sum follow the output received so far.   *
+ ******************************************************/
+static int runJob(int sockfd, int flags, const char *buf, size_t len, const char *key,
+                  char *out, uint64_t *id, size_t *offset, uint32_t *sum) {
+    uint32_t mode = flags & OTP_MODE_FLAGS;
+    uint32_t seedFlag = (flags & OTP_SEEDED) ? OTP_FLAG_SEED : 0;
+    struct otp_request request;
+    struct otp_seed seed;
+    struct otp_resume resume;
+    struct otp_job reply;
+    struct iovec iov[3];
+    unsigned char status;
+    size_t length;
+
+    // With a seed, it goes with every header and no key is sent.
+    if (seedFlag) {
+        packSeed(&seed, key, 0);
+    }
+    // Pick up where the last connection left off.
+    if (*id != 0) {
+        otp_pack_request(&request, mode, OTP_FLAG_RESUME | seedFlag, len);
+        resume.idHigh = htonl((uint32_t) (*id >> 32));
+        resume.idLow = htonl((uint32_t) *id);
+        resume.offsetHigh = htonl((uint32_t) ((uint64_t) *offset >> 32));
+        resume.offsetLow = htonl((uint32_t) *offset);
+        resume.checksum = htonl(*sum);
+
+        iov[0].iov_base = &request;
+        iov[0].iov_len = sizeof(request);
+        iov[1].iov_base = &seed;
+        iov[1].iov_len = seedFlag ? sizeof(seed) : 0;
+        iov[2].iov_base = &resume;
+        iov[2].iov_len = sizeof(resume);
+        if (otp_writev_full(sockfd, iov, 3) < 0 || otp_read_full(sockfd, &status, 1) != 1) {
+            return OTP_E_IO;
+        }
+        // The daemon forgot the job, or restarted: start over.
+        if (status == OTP_BAD_RESUME) {
+            *id = 0;
+        } else if (status != OTP_OK) {
+            return statusError(status);
+        }
+    }
+    if (*id == 0) {
+        *offset = 0;
+        *sum = 1;
+
+        otp_pack_request(&request, mode, OTP_FLAG_RESUMABLE | seedFlag, len);
+        iov[0].iov_base = &request;
+        iov[0].iov_len = sizeof(request);
+        iov[1].iov_base = &seed;
+        iov[1].iov_len = seedFlag ? sizeof(seed) : 0;
+        if (otp_writev_full(sockfd, iov, 2) < 0 || otp_read_full(sockfd, &status, 1) != 1) {
+            return OTP_E_IO;
+        }
+        if (status != OTP_OK) {
+            return statusError(status);
+        }
+        if (otp_read_full(sockfd, &reply, sizeof(reply)) != sizeof(reply)) {
+            return OTP_E_IO;
+        }
+        *id = ((uint64_t) ntohl(reply.idHigh) << 32) | ntohl(reply.idLow);
+    }
+    // Send the rest chunk by chunk, and keep track of what came back.
+    for (; *offset < len; *offset += length) {
+        length = len - *offset < OTP_CHUNK ? len - *offset : OTP_CHUNK;
+
+        iov[0].iov_base = (char *) buf + *offset;
+        iov[0].iov_len = length;
+        iov[1].iov_base = (char *) key + *offset;
+        iov[1].iov_len = seedFlag ? 0 : length;
+        if (otp_writev_full(sockfd, iov, 2) < 0 || otp_read_full(sockfd, &status, 1) != 1) {
+            return OTP_E_IO;
+        }
+        if (status != OTP_OK) {
+            return statusError(status);
+        }
+        if (otp_read_full(sockfd, out + *offset, length) != (ssize_t) length) {
+            return OTP_E_IO;
+        }
+        *sum = otp_checksum(*sum, out + *offset, length);
+    }
+    return 0;
+}
+
+/*******************************************************
+ * otp_resumable(): Encrypt or decrypt (which) len     *
+ *                  bytes of buf with key into out as  *
+ *                  a resumable job of the daemon on   *
+ *                  host:port. When the connection     *
+ *                  drops, reconnect and resume from   *
+ *                  the output already received, up to *
+ *                  OTP_RESUME_TRIES times.            *
+ ******************************************************/
+int otp_resumable(const char *host, int port, int which, int flags,
+                  const char *buf, size_t len, const char *key, size_t keylen, char *out) {
+    struct addrinfo *addrs;
+    uint64_t id = 0;
+    size_t offset = 0;
+    uint32_t sum = 1;
+    int sockfd, result, tries;
+
+    result = checkInput(flags, buf, len, key, keylen);
+    if (result < 0) {
+        return result;
+    }
+    addrs = resolve(host, port);
+    if (addrs == NULL) {
+        return OTP_E_CONNECT;
+    }
+    for (tries = 0; ; tries++) {
+        sockfd = connectAddrs(addrs, which);
+
+        // Nothing to resume if the daemon was never reached.
+        if (sockfd == OTP_E_REJECTED || (sockfd < 0 && tries == 0)) {
+            result = sockfd;
+            break;
+        }
+        result = OTP_E_IO;
+        if (sockfd >= 0) {
+            result = runJob(sockfd, flags, buf, len, key, out, &id, &offset, &sum);
+            close(sockfd);
+        }
+        if (result != OTP_E_IO || tries == OTP_RESUME_TRIES) {
+            break;
+        }
+        // Give the link a little longer to come back every time.
+        usleep((OTP_RESUME_DELAY_MS * 1000) << tries);
+    }
+    freeaddrinfo(addrs);
+    return result;
+}
+
+/*********************************************************
+* SHARDING OVER SEVERAL DAEMONS                          *
+*********************************************************/
+// States of a shard.
+#define SHARD_PENDING 0
+#define SHARD_RUNNING 1
+#define SHARD_DONE 2
+
+// States of a daemon connection.
+#define CONN_CONNECTING 0       // waiting for connect() to finish.
+#define CONN_HELLO_OUT 1        // sending the client name.
+#define CONN_HELLO_IN 2         // reading the daemon name.
+#define CONN_IDLE 3             // ready for a shard.
+#define CONN_SENDING 4          // sending a chunk (and the header).
+#define CONN_RECEIVING 5        // reading the status and the chunk back.
+#define CONN_DEAD 6             // daemon given up on.
+
+// A shard of the job.
+struct shard {
+    size_t start;               // offset of the shard in the text.
+    size_t length;              // length of the shard.
+    int state;                  // one of the SHARD_* values.
+    int tries;                  // number of daemons it was sent to.
+};
+
+// A connection to one of the daemons.
+struct shardConn {
+    int fd;
+    int state;                  // one of the CONN_* values.
+    int shard;                  // shard being processed, or -1.
+    size_t offset;              // offset of the current chunk in the text.
+    size_t length;              // length of the current chunk.
+    size_t done;                // bytes sent or received of the current step.
+    int sendHeader;             // the current chunk is the first of its shard.
+    struct otp_request header;  // header of the current shard.
+    struct otp_seed seed;       // seed sent after it with OTP_SEEDED.
+    unsigned char status;       // status byte of the current chunk.
+    char hello[OTP_NAME_MAX];   // daemon name being read.
+};
+
+// Everything otp_shard() works on.
+struct shardJob {
+    int which;
+    uint32_t mode;
+    int seeded;                 // the key is a seed.
+    const char *buf;
+    const char *key;
+    char *out;
+    struct shard *shards;
+    int numShards;
+    int numDone;
+    int numConns;
+    int error;                  // error that ends the whole job, or 0.
+};
+
+/*******************************************************
+ * startConnect(): Start a non-blocking connection to  *
+ *                 one daemon.                         *
+ ******************************************************/
+static void startConnect(struct shardConn *conn, const char *host, int port) {
+    struct addrinfo *addrs = resolve(host, port);
+    int value = 1;
+
+    conn->fd = -1;
+    conn->state = CONN_DEAD;
+    conn->shard = -1;
+    conn->done = 0;
+
+    if (addrs == NULL) {
+        return;
+    }
+    conn->fd = socket(addrs->ai_family, addrs->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      addrs->ai_protocol);
+    if (conn->fd >= 0) {
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+        if (connect(conn->fd, addrs->ai_addr, addrs->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            conn->state = CONN_CONNECTING;
+        } else {
+            close(conn->fd);
+            conn->fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+}
+
+/*******************************************************
+ * dropConn(): Give up on a daemon. Its shard goes     *
+ *             back to the queue for another daemon.   *
+ ******************************************************/
+static void dropConn(struct shardJob *job, struct shardConn *conn, int error) {
+    if (conn->fd >= 0) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    if (conn->shard >= 0) {
+        job->shards[conn->shard].state = SHARD_PENDING;
+
+        // Every daemon already failed on this shard.
+        if (job->shards[conn->shard].tries >= job->numConns) {
+            job->error = error;
+        }
+    }
+    conn->shard = -1;
+    conn->state = CONN_DEAD;
+}
+
+/*******************************************************
+ * nextShard(): Hand a pending shard to an idle        *
+ *              connection.                            *
+ ******************************************************/
+static void nextShard(struct shardJob *job, struct shardConn *conn) {
+    int i;
+
+    for (i = 0; i < job->numShards; i++) {
+        if (job->shards[i].state == SHARD_PENDING) {
+            job->shards[i].state = SHARD_RUNNING;
+            job->shards[i].tries++;
+
+            conn->shard = i;
+            conn->offset = job->shards[i].start;
+            conn->length = job->shards[i].length < OTP_CHUNK ? job->shards[i].length : OTP_CHUNK;
+            conn->sendHeader = 1;
+            conn->done = 0;
+            conn->state = CONN_SENDING;
+            otp_pack_request(&conn->header, job->mode, job->seeded ? OTP_FLAG_SEED : 0,
+                             job->shards[i].length);
+            if (job->seeded) {
+                packSeed(&conn->seed, job->key, job->shards[i].start);
+            }
+            return;
+        }
+    }
+}
+
+/*******************************************************
+ * sendChunk(): Send as much of the current chunk (and *
+ *              of the shard header) as the socket     *
+ *              takes. Returns -1 on error.            *
+ ******************************************************/
+static int sendChunk(struct shardJob *job, struct shardConn *conn) {
+    struct iovec iov[4];
+    size_t skip = conn->done;
+    size_t parts[4];
+    const char *bases[4];
+    int i, count = 0;
+    ssize_t n;
+
+    bases[0] = (const char *) &conn->header;
+    parts[0] = conn->sendHeader ? sizeof(conn->header) : 0;
+    bases[1] = (const char *) &conn->seed;
+    parts[1] = conn->sendHeader && job->seeded ? sizeof(conn->seed) : 0;
+    bases[2] = job->buf + conn->offset;
+    parts[2] = conn->length;
+    bases[3] = job->seeded ? job->key : job->key + conn->offset;
+    parts[3] = job->seeded ? 0 : conn->length;
+
+    // Leave out what was already sent.
+    for (i = 0; i < 4; i++) {
+        if (skip >= parts[i]) {
+            skip -= parts[i];
+            continue;
+        }
+        iov[count].iov_base = (char *) bases[i] + skip;
+        iov[count].iov_len = parts[i] - skip;
+        skip = 0;
+        count++;
+    }
+    n = writev(conn->fd, iov, count);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    conn->done += n;
+
+    if (conn->done == parts[0] + parts[1] + parts[2] + parts[3]) {
+        conn->done = 0;
+        conn->state = CONN_RECEIVING;
+    }
+    return 0;
+}
+
+/*******************************************************
+ * receiveChunk(): Read as much of the status and of   *
+ *                 the chunk back as there is. Returns *
+ *                 -1 on error.                        *
+ ******************************************************/
+static int receiveChunk(struct shardJob *job, struct shardConn *conn) {
+    struct shard *current = &job->shards[conn->shard];
+    ssize_t n;
+
+    if (conn->done == 0) {
+        n = read(conn->fd, &conn->status, 1);
+        if (n <= 0) {
+            return (n < 0 && (errno == EAGAIN || errno == EINTR)) ? 0 : -1;
+        }
+        // A bad text or key fails the same way on every daemon.
+        if (conn->status != OTP_OK) {
+            job->error = statusError(conn->status);
+            return -1;
+        }
+        conn->done = 1;
+    }
+    n = read(conn->fd, job->out + conn->offset + conn->done - 1, conn->length + 1 - conn->done);
+    if (n <= 0) {
+        return (n < 0 && (errno == EAGAIN || errno == EINTR)) ? 0 : -1;
+    }
+    conn->done += n;
+
+    if (conn->done < conn->length + 1) {
+        return 0;
+    }
+    // Move on to the next chunk of the shard, or to the next shard.
+    conn->offset += conn->length;
+    conn->done = 0;
+    conn->sendHeader = 0;
+
+    if (conn->offset < current->start + current->length) {
+        conn->length = current->start + current->length - conn->offset;
+        if (conn->length > OTP_CHUNK) {
+            conn->length = OTP_CHUNK;
+        }
+        conn->state = CONN_SENDING;
+    } else {
+        current->state = SHARD_DONE;
+        job->numDone++;
+        conn->shard = -1;
+        conn->state = CONN_IDLE;
+    }
+    return 0;
+}
+
+/*******************************************************
+ * stepConn(): Move a connection forward after poll()  *
+ *             said it's ready. Returns -1 on error.   *
+ ******************************************************/
+static int stepConn(struct shardJob *job, struct shardConn *conn) {
+    const char *name = clientName[job->which];
+    socklen_t size = sizeof(int);
+    int error = 0;
+    ssize_t n;
+
+    switch (conn->state) {
+    case CONN_CONNECTING:
+        if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &size) < 0 || error != 0) {
+            return -1;
+        }
+        conn->state = CONN_HELLO_OUT;
+        conn->done = 0;
+        // The socket is writable, send the name right away.
+        /* FALLTHROUGH */
+    case CONN_HELLO_OUT:
+        n = write(conn->fd, name + conn->done, strlen(name) + 1 - conn->done);
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        }
+        conn->done += n;
+        if (conn->done == strlen(name) + 1) {
+            conn->state = CONN_HELLO_IN;
+            conn->done = 0;
+        }
+        return 0;
+    case CONN_HELLO_IN:
+        n = read(conn->fd, conn->hello + conn->done, 1);
+        if (n <= 0) {
+            return (n < 0 && (errno == EAGAIN || errno == EINTR)) ? 0 : -1;
+        }
+        if (conn->hello[conn->done] != '\0') {
+            return ++conn->done < OTP_NAME_MAX ? 0 : -1;
+        }
+        if (strcmp(conn->hello, daemonName[job->which]) != 0) {
+            return -1;
+        }
+        conn->state = CONN_IDLE;
+        return 0;
+    case CONN_SENDING:
+        return sendChunk(job, conn);
+    case CONN_RECEIVING:
+        return receiveChunk(job, conn);
+    }
+    return 0;
+}
+
+/*******************************************************
+ * otp_shard(): Split the text and the key into shards *
+ *              and send them to the daemons on every  *
+ *              port of ports at the same time, over   *
+ *              non-blocking sockets. The results are  *
+ *              put back together in order in out. A   *
+ *              shard whose daemon fails is sent to    *
+ *              another one.                           *
+ ******************************************************/
+int otp_shard(const char *host, const int *ports, int numPorts, int which, int flags,
+              const char *buf, size_t len, const char *key, size_t keylen, char *out) {
+    struct shardJob job;
+    struct shardConn *conns;
+    struct pollfd *fds;
+    size_t shardLength;
+    int i, live, result;
+
+    job.which = which;
+    job.mode = flags & OTP_MODE_FLAGS;
+    job.seeded = (flags & OTP_SEEDED) != 0;
+    job.buf = buf;
+    job.key = key;
+    job.out = out;
+    job.numDone = 0;
+    job.numConns = numPorts;
+    job.error = 0;
+
+    result = checkInput(flags, buf, len, key, keylen);
+    if (result < 0) {
+        return result;
+    }
+    if (len == 0 || numPorts < 1) {
+        return numPorts < 1 ? OTP_E_CONNECT : 0;
+    }
+    // A few shards per daemon, so the faster daemons take more of them,
+    // but no shard smaller than a chunk.
+    job.numShards = numPorts * OTP_SHARDS_PER_DAEMON;
+    if ((len + OTP_CHUNK - 1) / OTP_CHUNK < (size_t) job.numShards) {
+        job.numShards = (len + OTP_CHUNK - 1) / OTP_CHUNK;
+    }
+    shardLength = (len + job.numShards - 1) / job.numShards;
+
+    job.shards = calloc(job.numShards, sizeof(struct shard));
+    conns = calloc(numPorts, sizeof(struct shardConn));
+    fds = calloc(numPorts, sizeof(struct pollfd));
+
+    if (job.shards == NULL || conns == NULL || fds == NULL) {
+        free(job.shards);
+        free(conns);
+        free(fds);
+        return OTP_E_NOMEM;
+    }
+    for (i = 0; i < job.numShards; i++) {
+        job.shards[i].start = i * shardLength;
+        job.shards[i].length = i == job.numShards - 1 ? len - job.shards[i].start : shardLength;
+        job.shards[i].state = SHARD_PENDING;
+    }
+    for (i = 0; i < numPorts; i++) {
+        startConnect(&conns[i], host, ports[i]);
+    }
+
+    // Drive every connection until all the shards are back.
+    while (job.numDone < job.numShards && job.error == 0) {
+        live = 0;
+        for (i = 0; i < numPorts; i++) {
+            if (conns[i].state == CONN_IDLE) {
+                nextShard(&job, &conns[i]);
+            }
+            fds[i].fd = -1;
+            fds[i].events = 0;
+            fds[i].revents = 0;
+
+            if (conns[i].state == CONN_DEAD || conns[i].state == CONN_IDLE) {
+                continue;
+            }
+            fds[i].fd = conns[i].fd;
+            fds[i].events = (conns[i].state == CONN_CONNECTING || conns[i].state == CONN_HELLO_OUT
+                             || conns[i].state == CONN_SENDING) ? POLLOUT : POLLIN;
+            live++;
+        }
+        // Every daemon failed.
+        if (live == 0) {
+            job.error = OTP_E_CONNECT;
+            break;
+        }
+        if (poll(fds, numPorts, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            job.error = OTP_E_IO;
+            break;
+        }
+        for (i = 0; i < numPorts; i++) {
+            if (fds[i].revents != 0 && stepConn(&job, &conns[i]) < 0) {
+                dropConn(&job, &conns[i], job.error != 0 ? job.error : OTP_E_IO);
+            }
+        }
+    }
+
+    for (i = 0; i < numPorts; i++) {
+        if (conns[i].fd >= 0) {
+            close(conns[i].fd);
+        }
+    }
+    free(job.shards);
+    free(conns);
+    free(fds);
+    return job.error;
+}
+
+/*******************************************************
+ * otp_pool_open(): Create a connection pool for the   *
+ *                  daemon on host:port. Returns NULL  *
+ *                  if the host cannot be resolved.    *
+ ******************************************************/
+struct otp_pool *otp_pool_open(const char *host, int port, int which) {
+    struct otp_pool *pool = malloc(sizeof(struct otp_pool));
+
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->which = which;
+    pool->numIdle = 0;
+    pool->addrs = resolve(host, port);
+
+    if (pool->addrs == NULL) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/*******************************************************
+ * otp_pool_get(): Take an idle connection from the    *
+ *                 pool, or open a new one.            *
+ ******************************************************/
+int otp_pool_get(struct otp_pool *pool) {
+    char probe;
+    int sockfd;
+
+    while (pool->numIdle > 0) {
+        sockfd = pool->idle[--pool->numIdle];
+
+        // The daemon drops connections that stay idle for too long,
+        // so only hand out the ones that are still open.
+        if (recv(sockfd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) < 0
+                && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return sockfd;
+        }
+        close(sockfd);
+    }
+    return connectAddrs(pool->addrs, pool->which);
+}
+
+/*******************************************************
+ * otp_pool_put(): Give a connection back to the pool  *
+ *                 along with the result of the last   *
+ *                 request made on it. Connections     *
+ *                 that failed are closed.             *
+ ******************************************************/
+void otp_pool_put(struct otp_pool *pool, int sockfd, int result) {
+    if (sockfd < 0) {
+        return;
+    }
+    if (result == 0 && pool->numIdle < OTP_POOL_SIZE) {
+        pool->idle[pool->numIdle++] = sockfd;
+    } else {
+        close(sockfd);
+    }
+}
+
+/*******************************************************
+ * otp_pool_close(): Close every idle connection and   *
+ *                   free the pool.                    *
+ ******************************************************/
+void otp_pool_close(struct otp_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+    while (pool->numIdle > 0) {
+        close(pool->idle[--pool->numIdle]);
+    }
+    freeaddrinfo(pool->addrs);
+    free(pool);
+}
+
+/*******************************************************
+ * otp_read_file(): Read a whole file into a new       *
+ *                  buffer. Returns NULL if the file   *
+ *                  cannot be read.                    *
+ ******************************************************/
+char *otp_read_file(const char *path, size_t *len) {
+    struct stat info;
+    size_t size = 4096;
+    char *buffer, *bigger;
+    ssize_t n;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    // Size the buffer after the file, but keep growing it in case
+    // the file is a pipe or is still being written to.
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        size = info.st_size + 1;
+    }
+    buffer = malloc(size);
+    *len = 0;
+
+    while (buffer != NULL) {
+        if (*len == size) {
+            bigger = realloc(buffer, size * 2);
+            if (bigger == NULL) {
+                break;
+            }
+            buffer = bigger;
+            size *= 2;
+        }
+        n = read(fd, buffer + *len, size - *len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            if (n == 0) {
+                return buffer;
+            }
+            free(buffer);
+            return NULL;
+        }
+        *len += n;
+    }
+    close(fd);
+    free(buffer);
+    return NULL;
+}
+
+/*******************************************************
+ * otp_strerror(): Describe an OTP_E_* error code.     *
+ ******************************************************/
+const char *otp_strerror(int err) {
+    switch (err) {
+    case OTP_E_TEXT:
+        return "text contains invalid characters";
+    case OTP_E_KEY:
+        return "key contains invalid characters";
+    case OTP_E_SHORTKEY:
+        return "key is too short";
+    case OTP_E_CONNECT:
+        return "could not connect to daemon";
+    case OTP_E_REJECTED:
+        return "wrong daemon on given port";
+    case OTP_E_IO:
+        return "connection to daemon failed";
+    case OTP_E_NOMEM:
+        return "out of memory";
+    case OTP_E_MODE:
+        return "mode not supported by daemon";
+    case OTP_E_FILE:
+        return "daemon cannot use the files given";
+    }
+    return "no error";
+}
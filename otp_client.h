@@ -0,0 +1,122 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_client.h                                              *
+ **                                                                        *
+ ** Description: libotpclient, the client side of the OTP daemons as an    *
+ **              in-process library. otp_enc and otp_dec are thin          *
+ **              wrappers over it, and applications can link it directly   *
+ **              instead of running those programs and parsing stdout.     *
+ **                                                                        *
+ **              otp_encrypt() and otp_decrypt() work on the 27 character  *
+ **              alphabet ('A'-'Z' and space). otp_encrypt_bytes() and     *
+ **              otp_decrypt_bytes() take any byte and XOR it with a       *
+ **              binary pad, as made by keygen -b. The calls taking flags  *
+ **              also work on the other alphabets of otp_kernel.h.         *
+ **                                                                        *
+ **              otp_encrypt_files() and otp_decrypt_files() talk to a     *
+ **              daemon on the same host over its Unix-domain socket (see  *
+ **              otp_connect_unix()). They pass the file descriptors of    *
+ **              the text, the key and the output instead of the bytes.    *
+ **                                                                        *
+ **              With OTP_SEEDED, the key passed to the calls taking flags *
+ **              is a seed made by keygen -s instead of a pad. Only the    *
+ **              seed goes to the daemon, which derives the key from it,   *
+ **              so half as many bytes travel. A seed, like a pad, must    *
+ **              be used for one message only.                             *
+ **                                                                        *
+ **              otp_resumable() runs a job as a resumable job of the      *
+ **              daemon (see otp_jobs.h). If the connection drops, it      *
+ **              reconnects and only sends the part whose output didn't    *
+ **              come back.                                                *
+ **                                                                        *
+ **              otp_shard() splits a big job into shards and spreads them *
+ **              over several daemons of the same kind at once.            *
+ **                                                                        *
+ **              Connections can be reused for any number of requests. A   *
+ **              struct otp_pool resolves the daemon address once and      *
+ **              keeps idle connections around for the next request.       *
+ **                                                                        *
+ **              Unless stated otherwise, the functions return 0 (or a     *
+ **              file descriptor) on success and one of the negative       *
+ **              OTP_E_* codes on failure.                                 *
+ **************************************************************************/
+
+#ifndef OTP_CLIENT_H
+#define OTP_CLIENT_H
+
+#include <stddef.h>
+
+// Daemon to talk to.
+#define OTP_ENC 0           // otp_enc_d
+#define OTP_DEC 1           // otp_dec_d
+
+// Error codes.
+#define OTP_E_TEXT -1       // the text contains bad characters.
+#define OTP_E_KEY -2        // the key contains bad characters.
+#define OTP_E_SHORTKEY -3   // the key is shorter than the text.
+#define OTP_E_CONNECT -4    // the daemon cannot be reached.
+#define OTP_E_REJECTED -5   // the daemon on that port is the wrong one.
+#define OTP_E_IO -6         // the connection failed mid-request.
+#define OTP_E_NOMEM -7      // out of memory.
+#define OTP_E_MODE -8       // the daemon doesn't support the mode.
+#define OTP_E_FILE -9       // the daemon cannot use the files passed.
+
+// Flags for otp_resumable(), otp_shard() and the *_files() calls. The
+// low byte is the mode: text in the 27 character alphabet by default,
+// or one of these (the request modes of otp_proto.h).
+#define OTP_BINARY 1        // binary (XOR) mode instead of text.
+#define OTP_BASE32 2        // text in base-32 ('A'-'Z' and '2'-'7').
+#define OTP_ALNUM 3         // text in digits and letters.
+#define OTP_PRINTABLE 4     // text in printable ASCII.
+#define OTP_MODE_FLAGS 0xff // mode part of the flags.
+#define OTP_SEEDED 0x100    // the key is a seed made by keygen -s.
+
+// Length of a seed: a ChaCha20 key and nonce.
+#define OTP_SEED_SIZE 44
+
+// Reconnections tried by otp_resumable(), the first one after
+// OTP_RESUME_DELAY_MS and each one after twice as long as the last.
+#define OTP_RESUME_TRIES 5
+#define OTP_RESUME_DELAY_MS 100
+
+// Shards made per daemon by otp_shard().
+#define OTP_SHARDS_PER_DAEMON 4
+
+// Most idle connections kept by a pool.
+#define OTP_POOL_SIZE 8
+
+struct addrinfo;
+
+// Connection pool for one daemon.
+struct otp_pool {
+    int which;                      // OTP_ENC or OTP_DEC.
+    struct addrinfo *addrs;         // cached address resolution.
+    int numIdle;                    // number of idle connections.
+    int idle[OTP_POOL_SIZE];        // idle connections.
+};
+
+int otp_connect(const char *host, int port, int which);
+int otp_encrypt(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out);
+int otp_decrypt(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out);
+int otp_encrypt_bytes(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out);
+int otp_decrypt_bytes(int sockfd, const char *buf, size_t len, const char *key, size_t keylen, char *out);
+int otp_connect_unix(const char *path, int which);
+int otp_encrypt_files(int sockfd, int flags, int textfd, size_t len,
+                      int keyfd, size_t keylen, int outfd);
+int otp_decrypt_files(int sockfd, int flags, int textfd, size_t len,
+                      int keyfd, size_t keylen, int outfd);
+int otp_resumable(const char *host, int port, int which, int flags,
+                  const char *buf, size_t len, const char *key, size_t keylen, char *out);
+int otp_shard(const char *host, const int *ports, int numPorts, int which, int flags,
+              const char *buf, size_t len, const char *key, size_t keylen, char *out);
+
+struct otp_pool *otp_pool_open(const char *host, int port, int which);
+int otp_pool_get(struct otp_pool *pool);
+void otp_pool_put(struct otp_pool *pool, int sockfd, int result);
+void otp_pool_close(struct otp_pool *pool);
+
+char *otp_read_file(const char *path, size_t *len);
+const char *otp_strerror(int err);
+
+#endif
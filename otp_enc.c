@@ -14,226 +14,295 @@
  **              error to the screen with the bad port, and set the exit   *
  **              value to 2. Otherwise, on successfully running, otp_enc   *
  **              sets the exit value to 0. otp_enc is NOT able to connect  *
- **              to otp_dec_d.                                             *
+ **              to otp_dec_d. The work is done by libotpclient            *
+ **              (otp_client.h), of which otp_enc is a thin wrapper.       *
  **************************************************************************/
 
-#include <arpa/inet.h>
-#include <fcntl.h>     
-#include <netdb.h>
-#include <netinet/in.h>
-#include <stdio.h>     
-#include <stdlib.h>    
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <sys/stat.h> 
-#include <sys/types.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#define BUFFERSIZE 100000
+#include "otp_client.h"
+#include "otp_kernel.h"
 
-// Main body (CODE TAKEN FROM SERVER)
-int main(int argc, char *argv[]) {
+#define MAXPORTS 64
 
-    // Declare variables.
-    int writer, n;
-    int value = 1;
-    int key_length;
-    int returnedData;
-    int input_length;
-    int i, file_opener;
-    int sockfd, portno;
-    char tempBuffer[1];
-    char keyBuffer[BUFFERSIZE];
-    char textBuffer[BUFFERSIZE];
-    char valiBuffer[BUFFERSIZE];
-    struct hostent *server;
-    struct sockaddr_in serv_addr;
-    
-    /*******************************************************
-    * OPEN AND READ INPUT ARGUMENTS/FILES.                 *
-    *******************************************************/
-    // Check if there are enough arguments.
-    if (argc < 4) {
-        printf("Usage: otp_enc plaintext key port\n");
-        exit(1);
-    }
-    // Interpret argument content as an integer to get the port number.
-    portno = atoi(argv[3]);
-    
-    // Open the argument/file that should contain the plaintext file.
-    file_opener = open(argv[1], O_RDONLY);
+/*********************************************************
+* readInput(): Function to read a whole input file and   *
+*              strip its trailing newline (text mode     *
+*              only).                                    *
+*********************************************************/
+static char *readInput(const char *path, const char *what, size_t *length, int binary) {
+
+    char *buffer = otp_read_file(path, length);
 
     // Check for opening errors.
-    if (file_opener < 0) {
-        printf("Error: cannot open plaintext file %s\n", argv[1]);
+    if (buffer == NULL) {
+        printf("Error: cannot open %s file %s\n", what, path);
         exit(1);
     }
-    // Read the content of the plaintext file and place
-    // it into the buffer and also get its length.
-    input_length = read(file_opener, textBuffer, BUFFERSIZE);
-   
-    // Clear temporary buffer.
-    bzero(tempBuffer, sizeof(tempBuffer));
-
-    // Validate the contents inside the plaintext file.
-    while (read(file_opener, tempBuffer, 1) != 0) {
-        if (tempBuffer[0]!=' '&&(tempBuffer[0]<'A'||tempBuffer[0]>'Z')) {
-            if (tempBuffer[0] != '\n') {
-                fprintf(stderr,"%s contains invalid characters\n", argv[1]);
-                exit(EXIT_FAILURE);
-            }
-        }
+    // The last character of a text file is a newline.
+    if (!binary && *length > 0 && buffer[*length - 1] == '\n') {
+        *length -= 1;
     }
-    // Close plaintext file.
-    close(file_opener);
+    return buffer;
+}
+
+/*********************************************************
+* openInput(): Function to open an input file to pass to *
+*              the daemon, and find its length without   *
+*              the trailing newline (text mode only).    *
+*********************************************************/
+static int openInput(const char *path, const char *what, size_t *length, int binary) {
+
+    struct stat info;
+    char last;
+    int fd = open(path, O_RDONLY);
 
-    // Open the argument/file that should contain the key file.
-    file_opener = open(argv[2], O_RDONLY);
-    
     // Check for opening errors.
-    if (file_opener < 0) {
-        printf("Error: cannot open key file %s\n", argv[2]);
+    if (fd < 0 || fstat(fd, &info) < 0) {
+        printf("Error: cannot open %s file %s\n", what, path);
         exit(1);
     }
-    // Read the content of the key file and place
-    // it into the buffer and also get its length.
-    key_length = read(file_opener, keyBuffer, BUFFERSIZE);
- 
-    // Clear temporary buffer.
-    bzero(tempBuffer, sizeof(tempBuffer));
-
-    // Validate the contents inside the key file.
-    while (read(file_opener, tempBuffer, 1) != 0) {
-        if (tempBuffer[0]!=' '&&(tempBuffer[0]<'A'||tempBuffer[0]>'Z')) {
-            if (tempBuffer[0] != '\n') {
-                fprintf(stderr,"%s contains invalid characters\n", argv[1]);
-                exit(EXIT_FAILURE);
-            }
-        }
+    *length = info.st_size;
+
+    // The last character of a text file is a newline.
+    if (!binary && *length > 0 && pread(fd, &last, 1, *length - 1) == 1 && last == '\n') {
+        *length -= 1;
     }
-    // Close key file.
-    close(file_opener);
+    return fd;
+}
 
-    // Check if key file is as long as the plaintext file.
-    if (key_length < input_length) {
-        printf("Error: key '%s' is too short\n", argv[2]);
+/*********************************************************
+* checkSeed(): Function to make sure the key given with  *
+*              -s is a seed made by keygen -s.           *
+*********************************************************/
+static void checkSeed(const char *path, int flags, size_t length) {
+
+    if ((flags & OTP_SEEDED) && length != OTP_SEED_SIZE) {
+        printf("Error: '%s' is not a seed made by keygen -s\n", path);
+        exit(1);
     }
-    
-    /*********************************************************
-    * SOCKET SETTINGS.                                       *
-    *********************************************************/
-    // Create TPC socket.
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    
-    // Error checking.
-    if (sockfd < 0) {
-        printf("Error: could not contact otp_enc_d on port %d\n", portno);
+}
+
+/*********************************************************
+* encryptFiles(): Function to have the otp_enc_d         *
+*                 listening on the Unix-domain socket    *
+*                 path encrypt the plaintext file        *
+*                 straight to stdout.                    *
+*********************************************************/
+static int encryptFiles(const char *textPath, const char *keyPath, const char *path, int flags) {
+
+    int result;
+    int binary = (flags & OTP_MODE_FLAGS) == OTP_BINARY;
+    int sockfd, textfd, keyfd;
+    size_t input_length;
+    size_t key_length;
+
+    textfd = openInput(textPath, "plaintext", &input_length, binary);
+    keyfd = openInput(keyPath, "key", &key_length, binary || (flags & OTP_SEEDED));
+    checkSeed(keyPath, flags, key_length);
+
+    // Connect to the daemon. otp_enc is NOT able to connect to otp_dec_d.
+    sockfd = otp_connect_unix(path, OTP_ENC);
+
+    if (sockfd == OTP_E_REJECTED) {
+        fprintf(stderr, "unable to contact otp_enc_d on socket %s\n", path);
         exit(2);
     }
-    // Set host name.
-    server = gethostbyname("localhost");
-    
-    // Error checking.
-    if (server == NULL) {
-        printf("Error: could not connect to otp_enc_d\n");
+    if (sockfd < 0) {
+        printf("Error: could not connect to otp_enc_d on socket %s\n", path);
         exit(2);
     }
-    // Set SO_REUSEADDR on socket to be reused. It allows other sockets
-    // to bind() to this port, unless there is an active listening
-    // socket bound to the port already.
-	setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(int));
- 
-    // Clear the server address to which we want to connect.
-    bzero((char *) &serv_addr, sizeof(serv_addr));
-    
-    // Set the address family and the symbolic constant AF_INET.
-    serv_addr.sin_family = AF_INET;
-    
-    // Copy length bytes from h_addr to s_addr.
-    bcopy((char *)server->h_addr, (char *)&serv_addr.sin_addr.s_addr, server->h_length);
-    
-    // Converts port number from host byte order to network byte order.
-    serv_addr.sin_port = htons(portno);
-    
-    
-    /*********************************************************
-    * SENDING DATA TO otp_enc_d (Plaintext and key)          *
-    *********************************************************/
-    // Connect the socket to the server address and do error checking.
-    if (connect(sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
-        printf("Error: could not connect to otp_enc_d on port %d\n", portno);
-        exit(2);
+    // Nothing went to stdout yet, so the daemon can write there directly.
+    result = otp_encrypt_files(sockfd, flags, textfd, input_length,
+                               keyfd, key_length, STDOUT_FILENO);
+
+    close(sockfd);
+    close(textfd);
+    close(keyfd);
+    return result;
+}
+
+/*********************************************************
+* parsePorts(): Function to read a comma separated list  *
+*               of ports into ports. Returns how many    *
+*               there are.                               *
+*********************************************************/
+static int parsePorts(char *list, int ports[MAXPORTS]) {
+
+    int numPorts = 0;
+    char *token = strtok(list, ",");
+
+    while (token != NULL && numPorts < MAXPORTS) {
+        ports[numPorts++] = atoi(token);
+        token = strtok(NULL, ",");
     }
-    // Make sure otp_enc is NOT able to connect to otp_dec_d.
-    char auth[]="enc_bs";
-    
-    // Write process name to host.
-    write(sockfd, auth, sizeof(auth));
-    
-    // Read from host.
-    read(sockfd, valiBuffer, sizeof(valiBuffer));
-    
-    // Validate answer.
-    if (strcmp(valiBuffer, "enc_d_bs") != 0) {
-        fprintf(stderr,"unable to contact otp_enc_d on given port\n");
-        exit(2);
+    return numPorts;
+}
+
+// Main body.
+int main(int argc, char *argv[]) {
+
+    // Declare variables.
+    int result;
+    int option;
+    int binary = 0;
+    int flags = 0;
+    int portno;
+    int numPorts = 0;
+    int direct;
+    int ports[MAXPORTS];
+    size_t input_length;
+    size_t key_length;
+    char *textBuffer = NULL;
+    char *keyBuffer = NULL;
+    char *outBuffer = NULL;
+    const struct otp_alphabet *alphabet;
+
+    /*******************************************************
+    * OPEN AND READ INPUT ARGUMENTS/FILES.                 *
+    *******************************************************/
+    // -b selects binary mode: any byte, XOR with a binary key.
+    // -a selects another text alphabet (see otp_kernel.h).
+    // -s takes a seed made by keygen -s instead of a key.
+    while ((option = getopt(argc, argv, "a:bs")) != -1) {
+        switch (option) {
+        case 'a':
+            alphabet = otp_alphabet_named(optarg);
+            if (alphabet == NULL) {
+                printf("Error: unknown alphabet %s\n", optarg);
+                exit(1);
+            }
+            flags = (flags & ~OTP_MODE_FLAGS) | alphabet->mode;
+            break;
+        case 'b':
+            binary = 1;
+            flags = (flags & ~OTP_MODE_FLAGS) | OTP_BINARY;
+            break;
+        case 's':
+            flags |= OTP_SEEDED;
+            break;
+        default:
+            printf("Usage: otp_enc [-b | -a alphabet] [-s] plaintext key|seed port[,port...]|socket\n");
+            exit(1);
+        }
     }
-    // Write plaintext into the socket for encryption.
-    writer = write(sockfd, textBuffer, input_length-1);
-    
-    // Error checking.
-    if (writer < input_length - 1) {
-        printf("Error: could not send plaintext to otp_enc_d on port %d\n", portno);
-        exit(2);
+    // Shift the options away so argv[1] is the plaintext file.
+    argv += optind - 1;
+    argc -= optind - 1;
+
+    // Check if there are enough arguments.
+    if (argc < 4) {
+        printf("Usage: otp_enc [-b | -a alphabet] [-s] plaintext key|seed port[,port...]|socket\n");
+        exit(1);
     }
-    // Clear temporary buffer for server acknowledgement process.
-    memset(tempBuffer, 0, 1);
-    
-    // Get acknowledgement from server.
-    returnedData = read(sockfd, tempBuffer, 1);
-    
-    // Check error in server connection.
-    if (returnedData < 0) {
-       printf("Error receiving acknowledgement from otp_enc_d\n");
-       exit(2);
-    }
-    // Write key into the socket for encryption.
-    writer = write(sockfd, keyBuffer, key_length-1);
-    
-    // Error checking.
-    if (writer < key_length-1) {
-        printf("Error: could not send key to otp_enc_d on port %d\n", portno);
-        exit(2);
+    // A path (anything with a '/') instead of a port means the daemon
+    // runs on this host and listens on that Unix-domain socket.
+    direct = strchr(argv[3], '/') != NULL;
+
+    if (!direct) {
+        // Interpret argument content as a list of port numbers.
+        numPorts = parsePorts(argv[3], ports);
+        portno = ports[0];
+
+        if (numPorts == 0) {
+            printf("Error: no port given\n");
+            exit(2);
+        }
+
+        // Read the plaintext and the key files.
+        textBuffer = readInput(argv[1], "plaintext", &input_length, binary);
+        keyBuffer = readInput(argv[2], "key", &key_length, binary || (flags & OTP_SEEDED));
+        checkSeed(argv[2], flags, key_length);
+        outBuffer = malloc(input_length + 1);
+
+        if (outBuffer == NULL) {
+            fprintf(stderr, "otp_enc: %s\n", otp_strerror(OTP_E_NOMEM));
+            exit(1);
+        }
     }
-    
+
     /*********************************************************
-    * RECEIVE ENCRYPTED DATA FROM otp_enc_d.                 *
+    * SEND DATA TO otp_enc_d AND RECEIVE THE RESULT.        *
     *********************************************************/
-    // Clear buffer.
-    memset(textBuffer, 0, BUFFERSIZE);
+    // Hand the files themselves to a daemon on this host, or spread
+    // the work over several daemons when given more than one port.
+    if (direct) {
+        result = encryptFiles(argv[1], argv[2], argv[3], flags);
+    } else if (numPorts > 1) {
+        result = otp_shard("localhost", ports, numPorts, OTP_ENC, flags,
+                           textBuffer, input_length, keyBuffer, key_length, outBuffer);
 
-    // Read encrypted content and place it into textBuffer.
-    do {
-        returnedData = read(sockfd, textBuffer, input_length-1);
-    } while (returnedData > 0);
+        if (result == OTP_E_CONNECT) {
+            printf("Error: could not connect to any otp_enc_d\n");
+            exit(2);
+        }
+    } else {
+        // Run it as a resumable job, so a dropped connection only costs
+        // the tail. otp_enc is NOT able to connect to otp_dec_d.
+        result = otp_resumable("localhost", portno, OTP_ENC, flags,
+                               textBuffer, input_length, keyBuffer, key_length, outBuffer);
 
-    // Error checking.
-    if (returnedData < 0) {
-       printf("Error receiving ciphertext from otp_enc_d\n");
-       exit(2);
+        if (result == OTP_E_REJECTED) {
+            fprintf(stderr,"unable to contact otp_enc_d on given port\n");
+            exit(2);
+        }
+        if (result == OTP_E_CONNECT) {
+            printf("Error: could not connect to otp_enc_d on port %d\n", portno);
+            exit(2);
+        }
+    }
+
+    // Bad input files exit with 1, network errors with 2.
+    if (result == OTP_E_TEXT) {
+        fprintf(stderr, "%s contains invalid characters\n", argv[1]);
+        exit(1);
+    }
+    if (result == OTP_E_KEY) {
+        fprintf(stderr, "%s contains invalid characters\n", argv[2]);
+        exit(1);
+    }
+    if (result == OTP_E_SHORTKEY) {
+        printf("Error: key '%s' is too short\n", argv[2]);
+        exit(1);
+    }
+    if (result == OTP_E_MODE) {
+        fprintf(stderr, "otp_enc_d on %s does not support that mode\n", argv[3]);
+        exit(2);
+    }
+    if (result == OTP_E_FILE) {
+        fprintf(stderr, "otp_enc_d cannot use %s or %s\n", argv[1], argv[2]);
+        exit(1);
+    }
+    if (result < 0) {
+        printf("Error receiving ciphertext from otp_enc_d\n");
+        exit(2);
     }
 
     /*********************************************************
-    * OUTPUT ENCRYPTED DATA                                  *
+    * OUTPUT ENCRYPTED DATA                                 *
     *********************************************************/
     // Print encrypted content to console.
-    for (i = 0; i < input_length-1; i++) {
-        printf("%c", textBuffer[i]);
+    // Binary output is written as is, text gets its newline back.
+    // The daemon already wrote the output when passed the files.
+    if (direct) {
+        if (!binary) {
+            putchar('\n');
+        }
+        return 0;
     }
-    printf("\n");
+    if (!binary) {
+        outBuffer[input_length++] = '\n';
+    }
+    fwrite(outBuffer, 1, input_length, stdout);
 
-    // close socket
-    close(sockfd);
+    free(textBuffer);
+    free(keyBuffer);
+    free(outBuffer);
 
     return 0;
 }
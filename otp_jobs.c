@@ -0,0 +1,219 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_jobs.c                                                *
+ **                                                                        *
+ ** Description: Resumable job table (see otp_jobs.h). Like the scheduler, *
+ **              it sits in a shared mapping guarded by a process-shared,  *
+ **              robust mutex. The worker serving a job owns its entry; a  *
+ **              worker that resumes the job takes the entry over, and the *
+ **              old one gives up at its next checkpoint.                  *
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "otp_jobs.h"
+
+// A job that can be resumed.
+struct job {
+    uint64_t id;                // 0 when the entry is free.
+    uint32_t mode;
+    uint64_t length;            // total length of the job.
+    uint64_t acked;             // output the client is known to have.
+    uint32_t ackedSum;          // Adler-32 of it.
+    uint64_t sent;              // output sent so far.
+    uint32_t sentSum;           // Adler-32 of it.
+    pid_t owner;                // worker serving the job.
+    time_t lastUsed;            // time of the last checkpoint.
+};
+
+// Everything shared by the workers.
+struct jobTable {
+    pthread_mutex_t lock;
+    struct job jobs[OTP_MAX_JOBS];
+};
+
+static struct jobTable *table = NULL;
+
+/*******************************************************
+ * lockTable(): Take the lock, and take it over from   *
+ *              a worker that died holding it.         *
+ ******************************************************/
+static void lockTable(void) {
+    if (pthread_mutex_lock(&table->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&table->lock);
+    }
+}
+
+/*******************************************************
+ * findJob(): Return the entry of job id, or NULL.     *
+ ******************************************************/
+static struct job *findJob(uint64_t id) {
+    time_t now = time(NULL);
+    int i;
+
+    for (i = 0; i < OTP_MAX_JOBS; i++) {
+        if (table->jobs[i].id == id && now - table->jobs[i].lastUsed <= OTP_JOB_EXPIRE) {
+            return &table->jobs[i];
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************
+ * otp_jobs_enable(): Create the job table. It must be *
+ *                    called before the workers are    *
+ *                    forked. Returns -1 on failure.   *
+ ******************************************************/
+int otp_jobs_enable(void) {
+    pthread_mutexattr_t mutexAttr;
+    void *memory;
+
+    memory = mmap(NULL, sizeof(struct jobTable), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return -1;
+    }
+    table = memory;
+
+    pthread_mutexattr_init(&mutexAttr);
+    pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&table->lock, &mutexAttr);
+    pthread_mutexattr_destroy(&mutexAttr);
+    return 0;
+}
+
+/*******************************************************
+ * otp_job_create(): Start a job of length bytes owned *
+ *                   by this worker. Returns its ID,   *
+ *                   or 0 if jobs are not available.   *
+ ******************************************************/
+uint64_t otp_job_create(uint32_t mode, uint64_t length) {
+    struct job *entry = NULL;
+    time_t now = time(NULL);
+    uint64_t id;
+    int i;
+
+    if (table == NULL) {
+        return 0;
+    }
+    // The ID is what lets a client take the job over,
+    // so it must not be guessable.
+    do {
+        if (getrandom(&id, sizeof(id), 0) != sizeof(id)) {
+            return 0;
+        }
+    } while (id == 0);
+
+    // Take a free or expired entry, or else the finished
+    // job or the job checkpointed longest ago.
+    lockTable();
+    for (i = 0; i < OTP_MAX_JOBS; i++) {
+        struct job *candidate = &table->jobs[i];
+
+        if (candidate->id == 0 || now - candidate->lastUsed > OTP_JOB_EXPIRE) {
+            entry = candidate;
+            break;
+        }
+        if (entry == NULL
+                || (candidate->sent == candidate->length) > (entry->sent == entry->length)
+                || ((candidate->sent == candidate->length) == (entry->sent == entry->length)
+                    && candidate->lastUsed < entry->lastUsed)) {
+            entry = candidate;
+        }
+    }
+    entry->id = id;
+    entry->mode = mode;
+    entry->length = length;
+    entry->acked = entry->sent = 0;
+    entry->ackedSum = entry->sentSum = 1;
+    entry->owner = getpid();
+    entry->lastUsed = now;
+    pthread_mutex_unlock(&table->lock);
+
+    return id;
+}
+
+/*******************************************************
+ * otp_job_resume(): Take job id over from offset,     *
+ *                   where the client has output with  *
+ *                   the given checksum. Returns 0 if  *
+ *                   it matches a checkpoint, -1 if    *
+ *                   not.                              *
+ ******************************************************/
+int otp_job_resume(uint64_t id, uint32_t mode, uint64_t length, uint64_t offset, uint32_t checksum) {
+    struct job *entry;
+    int result = -1;
+
+    if (table == NULL || id == 0) {
+        return -1;
+    }
+    lockTable();
+    entry = findJob(id);
+    if (entry != NULL && entry->mode == mode && entry->length == length
+            && ((offset == entry->acked && checksum == entry->ackedSum)
+                || (offset == entry->sent && checksum == entry->sentSum))) {
+        entry->acked = entry->sent = offset;
+        entry->ackedSum = entry->sentSum = checksum;
+        entry->owner = getpid();
+        entry->lastUsed = time(NULL);
+        result = 0;
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    return result;
+}
+
+/*******************************************************
+ * otp_job_checkpoint(): Record the progress of job    *
+ *                       id. Returns -1 if the job is  *
+ *                       gone or was taken over by     *
+ *                       another worker.               *
+ ******************************************************/
+int otp_job_checkpoint(uint64_t id, uint64_t acked, uint32_t ackedSum, uint64_t sent, uint32_t sentSum) {
+    struct job *entry;
+    int result = -1;
+
+    if (table == NULL || id == 0) {
+        return 0;
+    }
+    lockTable();
+    entry = findJob(id);
+    if (entry != NULL && entry->owner == getpid()) {
+        entry->acked = acked;
+        entry->ackedSum = ackedSum;
+        entry->sent = sent;
+        entry->sentSum = sentSum;
+        entry->lastUsed = time(NULL);
+        result = 0;
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    return result;
+}
+
+/*******************************************************
+ * otp_job_finish(): Forget job id, once the client    *
+ *                   has shown it has all the output.  *
+ ******************************************************/
+void otp_job_finish(uint64_t id) {
+    struct job *entry;
+
+    if (table == NULL || id == 0) {
+        return;
+    }
+    lockTable();
+    entry = findJob(id);
+    if (entry != NULL && entry->owner == getpid()) {
+        entry->id = 0;
+    }
+    pthread_mutex_unlock(&table->lock);
+}
@@ -0,0 +1,39 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_jobs.h                                                *
+ **                                                                        *
+ ** Description: Resumable jobs. A request sent with OTP_FLAG_RESUMABLE    *
+ **              gets a job ID from the daemon, and its progress is        *
+ **              checkpointed after every chunk in a table shared by all   *
+ **              the workers: the offset the client acknowledged (by       *
+ **              sending the next chunk), the offset sent out, and the     *
+ **              Adler-32 of the output up to each of them. When the       *
+ **              connection drops, the client reconnects and resumes the   *
+ **              job from the output it has, as long as its offset and     *
+ **              checksum match one of the two checkpoints. Only the tail  *
+ **              is sent again.                                            *
+ **                                                                        *
+ **              The table lives as long as the daemon. Jobs are dropped   *
+ **              OTP_JOB_EXPIRE seconds after their last checkpoint, or    *
+ **              earlier when the table fills up, finished ones first.     *
+ **************************************************************************/
+
+#ifndef OTP_JOBS_H
+#define OTP_JOBS_H
+
+#include <stdint.h>
+
+// Most jobs remembered at a time.
+#define OTP_MAX_JOBS 64
+
+// Seconds a job can be resumed after its last checkpoint.
+#define OTP_JOB_EXPIRE 600
+
+int otp_jobs_enable(void);
+uint64_t otp_job_create(uint32_t mode, uint64_t length);
+int otp_job_resume(uint64_t id, uint32_t mode, uint64_t length, uint64_t offset, uint32_t checksum);
+int otp_job_checkpoint(uint64_t id, uint64_t acked, uint32_t ackedSum, uint64_t sent, uint32_t sentSum);
+void otp_job_finish(uint64_t id);
+
+#endif
@@ -0,0 +1,271 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_kernel.c                                              *
+ **                                                                        *
+ ** Description: Cipher kernels (see otp_kernel.h).                        *
+ **************************************************************************/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "otp_kernel.h"
+#include "otp_proto.h"
+
+// The text alphabets. A new one only needs a line here, a mode in
+// otp_proto.h, and no more than OTP_MAX_SYMBOLS distinct symbols.
+static struct otp_alphabet alphabets[] = {
+    {.name = "text", .mode = OTP_MODE_TEXT,
+     .symbols = " ABCDEFGHIJKLMNOPQRSTUVWXYZ"},
+    {.name = "base32", .mode = OTP_MODE_BASE32,
+     .symbols = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567"},
+    {.name = "alnum", .mode = OTP_MODE_ALNUM,
+     .symbols = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"},
+    {.name = "print", .mode = OTP_MODE_PRINT,
+     .symbols = " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                "[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~"},
+};
+
+#define NUM_ALPHABETS (sizeof(alphabets) / sizeof(alphabets[0]))
+
+static pthread_once_t tablesBuilt = PTHREAD_ONCE_INIT;
+
+// 32 bytes processed at a time. GCC maps this onto whatever vector
+// registers the target has (two SSE2 registers, one AVX2 register...).
+typedef unsigned char block __attribute__((vector_size(32)));
+
+// The same word of four ChaCha20 blocks, computed side by side.
+typedef uint32_t lanes __attribute__((vector_size(16)));
+
+// ChaCha20 blocks made at a time, and their words.
+#define STREAM_BLOCKS 4
+#define STREAM_WORDS (16 * STREAM_BLOCKS)
+
+#define ROTATE(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTATE(d, 16); \
+    c += d; b ^= c; b = ROTATE(b, 12); \
+    a += b; d ^= a; d = ROTATE(d, 8); \
+    c += d; b ^= c; b = ROTATE(b, 7);
+
+/*******************************************************
+ * buildTables(): Fill in the size and the lookup      *
+ *                tables of every alphabet.            *
+ ******************************************************/
+static void buildTables(void) {
+    struct otp_alphabet *alphabet;
+    unsigned i;
+
+    for (alphabet = alphabets; alphabet < alphabets + NUM_ALPHABETS; alphabet++) {
+        alphabet->size = strlen(alphabet->symbols);
+
+        memset(alphabet->index, OTP_NOT_SYMBOL, sizeof(alphabet->index));
+        for (i = 0; i < alphabet->size; i++) {
+            alphabet->index[(unsigned char) alphabet->symbols[i]] = i;
+        }
+        // Both indexes are below size, so their sum is below twice
+        // that, and so is the difference once size is added.
+        for (i = 0; i < 2 * alphabet->size; i++) {
+            alphabet->wrap[i] = alphabet->symbols[i % alphabet->size];
+        }
+    }
+}
+
+/*******************************************************
+ * otp_alphabet(): Return the alphabet of a request    *
+ *                 mode, or NULL if it isn't a text    *
+ *                 mode.                               *
+ ******************************************************/
+const struct otp_alphabet *otp_alphabet(uint32_t mode) {
+    size_t i;
+
+    pthread_once(&tablesBuilt, buildTables);
+    for (i = 0; i < NUM_ALPHABETS; i++) {
+        if (alphabets[i].mode == mode) {
+            return &alphabets[i];
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************
+ * otp_alphabet_named(): Return the alphabet called    *
+ *                       name, or NULL.                *
+ ******************************************************/
+const struct otp_alphabet *otp_alphabet_named(const char *name) {
+    size_t i;
+
+    pthread_once(&tablesBuilt, buildTables);
+    for (i = 0; i < NUM_ALPHABETS; i++) {
+        if (strcmp(alphabets[i].name, name) == 0) {
+            return &alphabets[i];
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************
+ * otp_valid_text(): Return 1 if buf only holds        *
+ *                   symbols of alphabet, 0 otherwise. *
+ ******************************************************/
+int otp_valid_text(const struct otp_alphabet *alphabet, const char *buf, size_t len) {
+    const unsigned char *index = alphabet->index;
+    unsigned char seen = 0;
+    size_t i;
+
+    // Only OTP_NOT_SYMBOL has the top bit set, so there is no
+    // need for a branch per byte.
+    for (i = 0; i < len; i++) {
+        seen |= index[(unsigned char) buf[i]];
+    }
+    return (seen & 0x80) == 0;
+}
+
+/*******************************************************
+ * otp_encrypt_text(): Encrypt length symbols of text  *
+ *                     with key into out.              *
+ ******************************************************/
+void otp_encrypt_text(const struct otp_alphabet *alphabet, const char *text, const char *key,
+                      char *out, size_t length) {
+    const unsigned char *index = alphabet->index;
+    const char *wrap = alphabet->wrap;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        out[i] = wrap[index[(unsigned char) text[i]] + index[(unsigned char) key[i]]];
+    }
+}
+
+/*******************************************************
+ * otp_decrypt_text(): Decrypt length symbols of text  *
+ *                     with key into out.              *
+ ******************************************************/
+void otp_decrypt_text(const struct otp_alphabet *alphabet, const char *text, const char *key,
+                      char *out, size_t length) {
+    const unsigned char *index = alphabet->index;
+    const char *wrap = alphabet->wrap + alphabet->size;
+    size_t i;
+
+    // Shifted by size, so a negative difference lands on its symbol.
+    for (i = 0; i < length; i++) {
+        out[i] = wrap[index[(unsigned char) text[i]] - index[(unsigned char) key[i]]];
+    }
+}
+
+/*******************************************************
+ * loadWord(): Read a little-endian 32-bit word.       *
+ ******************************************************/
+static uint32_t loadWord(const unsigned char *bytes) {
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8
+           | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+/*******************************************************
+ * streamBlocks(): Compute the ChaCha20 blocks counter *
+ *                 to counter + STREAM_BLOCKS - 1 into *
+ *                 stream, one block after the other.  *
+ ******************************************************/
+static void streamBlocks(const uint32_t input[16], uint32_t counter, uint32_t stream[STREAM_WORDS]) {
+    lanes start[16], x[16];
+    int i, j;
+
+    // Every lane is a block of its own, with its own counter.
+    for (i = 0; i < 16; i++) {
+        start[i] = (lanes) {input[i], input[i], input[i], input[i]};
+    }
+    start[12] = (lanes) {counter, counter + 1, counter + 2, counter + 3};
+    memcpy(x, start, sizeof(x));
+
+    // 20 rounds: a column round and a diagonal round, ten times.
+    for (i = 0; i < 10; i++) {
+        QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+        QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+        QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+        QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+        QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+        QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+        QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+        QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+    }
+    for (i = 0; i < 16; i++) {
+        x[i] += start[i];
+        for (j = 0; j < STREAM_BLOCKS; j++) {
+            stream[16 * j + i] = x[i][j];
+        }
+    }
+}
+
+/*******************************************************
+ * otp_expand_key(): Derive length symbols (or bytes   *
+ *                   in binary mode, with a NULL       *
+ *                   alphabet) of the key of seed into *
+ *                   out, from the one at position on. *
+ ******************************************************/
+void otp_expand_key(const struct otp_alphabet *alphabet, const unsigned char *seed,
+                    uint64_t position, char *out, size_t length) {
+    static const char sigma[] = "expand 32-byte k";
+    uint32_t input[16];
+    uint32_t stream[STREAM_WORDS];
+    uint64_t byte = position * (alphabet == NULL ? 1 : 4);
+    uint64_t counter = byte / 64 / STREAM_BLOCKS * STREAM_BLOCKS;
+    size_t skip = byte - counter * 64;
+    size_t i = 0, k;
+
+    // Constant, key, counter (set per block) and nonce.
+    for (k = 0; k < 4; k++) {
+        input[k] = loadWord((const unsigned char *) sigma + 4 * k);
+    }
+    for (k = 0; k < 8; k++) {
+        input[4 + k] = loadWord(seed + 4 * k);
+    }
+    for (k = 0; k < 3; k++) {
+        input[13 + k] = loadWord(seed + OTP_SEED_KEY_SIZE + 4 * k);
+    }
+    while (i < length) {
+        streamBlocks(input, (uint32_t) counter, stream);
+        counter += STREAM_BLOCKS;
+
+        if (alphabet == NULL) {
+            // The key stream bytes themselves, little-endian.
+            k = 4 * STREAM_WORDS - skip < length - i ? 4 * STREAM_WORDS - skip : length - i;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            memcpy(out + i, (const char *) stream + skip, k);
+            i += k;
+#else
+            for (k += skip; skip < k; skip++, i++) {
+                out[i] = (char) (stream[skip / 4] >> (8 * (skip % 4)));
+            }
+#endif
+        } else {
+            // A word scaled down to the alphabet size. The bias is
+            // below size / 2^32.
+            for (k = skip / 4; k < STREAM_WORDS && i < length; k++, i++) {
+                out[i] = alphabet->symbols[((uint64_t) stream[k] * alphabet->size) >> 32];
+            }
+        }
+        skip = 0;
+    }
+}
+
+/*******************************************************
+ * otp_xor(): XOR length bytes of text with key into   *
+ *            out. The same call encrypts and          *
+ *            decrypts.                                *
+ ******************************************************/
+void otp_xor(const char *text, const char *key, char *out, size_t length) {
+    block textBlock, keyBlock;
+    size_t i = 0;
+
+    // The buffers have no alignment guarantee, so go through
+    // memcpy, which compiles to unaligned vector loads and stores.
+    for (; i + sizeof(block) <= length; i += sizeof(block)) {
+        memcpy(&textBlock, text + i, sizeof(block));
+        memcpy(&keyBlock, key + i, sizeof(block));
+        textBlock ^= keyBlock;
+        memcpy(out + i, &textBlock, sizeof(block));
+    }
+    // Whatever doesn't fill a whole block.
+    for (; i < length; i++) {
+        out[i] = text[i] ^ key[i];
+    }
+}
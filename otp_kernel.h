@@ -0,0 +1,68 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_kernel.h                                              *
+ **                                                                        *
+ ** Description: Cipher kernels shared by otp_enc_d and otp_dec_d.         *
+ **                                                                        *
+ **              Text modes work on an alphabet of symbols: each symbol    *
+ **              stands for its index, and a text symbol is shifted by the *
+ **              key symbol modulo the size of the alphabet. The classic   *
+ **              alphabet is space and 'A'-'Z' (OTP_MODE_TEXT); the others *
+ **              are listed in otp_kernel.c, one line each, and selected   *
+ **              per request by their mode. Every alphabet gets lookup     *
+ **              tables built from its symbols: the index of every byte,   *
+ **              which also tells the bytes outside of it, and the symbol  *
+ **              of every sum of two indexes, which takes the place of the *
+ **              modulus. So all alphabets run through the same kernels,   *
+ **              at the same speed, without a division.                    *
+ **                                                                        *
+ **              otp_expand_key() derives a key from a seed made by keygen *
+ **              -s (a ChaCha20 key and nonce) instead of reading it from  *
+ **              a pad: the ChaCha20 key stream from its start, one byte   *
+ **              per byte in binary mode, or one 32-bit word per symbol in *
+ **              text mode, scaled down to an index of the alphabet.       *
+ **************************************************************************/
+
+#ifndef OTP_KERNEL_H
+#define OTP_KERNEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Most symbols in an alphabet. Indexes stay below 128, which leaves
+// the top bit of the index table to mark the bytes outside of it.
+#define OTP_MAX_SYMBOLS 128
+#define OTP_NOT_SYMBOL 0xff
+
+// A seed is a ChaCha20 key followed by a nonce.
+#define OTP_SEED_KEY_SIZE 32
+#define OTP_SEED_SIZE 44
+
+// Longest text a seed covers. The ChaCha20 block counter is 32 bits
+// wide, enough for 2^38 bytes of key stream, and text takes four
+// bytes of it per symbol.
+#define OTP_SEED_MAX_LENGTH ((uint64_t) 1 << 36)
+
+// A text alphabet and its lookup tables.
+struct otp_alphabet {
+    const char *name;                       // name given to -a.
+    uint32_t mode;                          // request mode that selects it.
+    const char *symbols;                    // the symbols, in index order.
+    unsigned size;                          // number of symbols.
+    unsigned char index[256];               // index of every byte, or OTP_NOT_SYMBOL.
+    char wrap[2 * OTP_MAX_SYMBOLS];         // symbol of every index below 2 * size.
+};
+
+const struct otp_alphabet *otp_alphabet(uint32_t mode);
+const struct otp_alphabet *otp_alphabet_named(const char *name);
+int otp_valid_text(const struct otp_alphabet *alphabet, const char *buf, size_t len);
+void otp_encrypt_text(const struct otp_alphabet *alphabet, const char *text, const char *key,
+                      char *out, size_t length);
+void otp_decrypt_text(const struct otp_alphabet *alphabet, const char *text, const char *key,
+                      char *out, size_t length);
+void otp_expand_key(const struct otp_alphabet *alphabet, const unsigned char *seed,
+                    uint64_t position, char *out, size_t length);
+void otp_xor(const char *text, const char *key, char *out, size_t length);
+
+#endif
@@ -0,0 +1,229 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_perf.c                                                *
+ **                                                                        *
+ ** Description: Performance counter profiling (see otp_perf.h). The       *
+ **              counters of a worker are opened the first time it         *
+ **              measures something and stay open until it exits; each     *
+ **              measurement costs two read() calls on the counter group.  *
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "otp_perf.h"
+
+// Counters read as one group, in this order.
+#define NUM_EVENTS 4
+#define NUM_PHASES 3
+#define NUM_BUCKETS OTP_SIZE_CLASSES
+
+static const uint64_t eventConfig[NUM_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// Payload-size buckets, by declared request length.
+static const uint64_t bucketLimit[NUM_BUCKETS] = {
+    1 << 10, 1 << 14, 1 << 18, 1 << 22, UINT64_MAX
+};
+static const char *bucketName[NUM_BUCKETS] = {
+    "<=1K", "<=16K", "<=256K", "<=4M", ">4M"
+};
+static const char *phaseName[NUM_PHASES] = {"validate", "transform", "expand"};
+
+// Totals of one phase in one bucket.
+struct perfTotals {
+    uint64_t samples;
+    uint64_t bytes;
+    uint64_t count[NUM_EVENTS];
+};
+
+// Group read format: number of counters followed by their values.
+struct groupRead {
+    uint64_t nr;
+    uint64_t values[NUM_EVENTS];
+};
+
+static struct perfTotals (*totals)[NUM_PHASES] = NULL;  // shared by all workers.
+static int groupFd = -1;        // counter group leader of this worker.
+static int eventFd[NUM_EVENTS]; // every counter of the group.
+static int failed = 0;          // the counters could not be opened.
+static struct groupRead start;  // counter values when the phase began.
+
+/*******************************************************
+ * otp_size_class(): Return the payload-size class of  *
+ *                   a request. The scheduler uses the *
+ *                   same classes.                     *
+ ******************************************************/
+int otp_size_class(uint64_t requestLength) {
+    int bucket = 0;
+
+    while (requestLength > bucketLimit[bucket]) {
+        bucket++;
+    }
+    return bucket;
+}
+
+/*******************************************************
+ * otp_size_class_name(): Name of a size class.        *
+ ******************************************************/
+const char *otp_size_class_name(int sizeClass) {
+    return bucketName[sizeClass];
+}
+
+/*******************************************************
+ * openCounters(): Open the counter group of this      *
+ *                 worker.                             *
+ ******************************************************/
+static int openCounters(void) {
+    struct perf_event_attr attr;
+    int i;
+
+    for (i = 0; i < NUM_EVENTS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = eventConfig[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        eventFd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : eventFd[0], 0);
+        if (eventFd[i] < 0) {
+            while (--i >= 0) {
+                close(eventFd[i]);
+            }
+            return -1;
+        }
+    }
+    groupFd = eventFd[0];
+    ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 0;
+}
+
+/*******************************************************
+ * closeCounters(): Close the counter group.           *
+ ******************************************************/
+static void closeCounters(void) {
+    int i;
+
+    for (i = 0; i < NUM_EVENTS; i++) {
+        close(eventFd[i]);
+    }
+    groupFd = -1;
+}
+
+/*******************************************************
+ * otp_perf_enable(): Turn profiling on. It must be    *
+ *                    called before the workers are    *
+ *                    forked. Returns -1 on failure.   *
+ ******************************************************/
+int otp_perf_enable(void) {
+    void *memory;
+
+    // Make sure the counters can be opened at all. Every worker
+    // opens its own, so they are closed again right away.
+    if (openCounters() < 0) {
+        return -1;
+    }
+    closeCounters();
+
+    memory = mmap(NULL, sizeof(struct perfTotals) * NUM_PHASES * NUM_BUCKETS,
+                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return -1;
+    }
+    totals = memory;
+    return 0;
+}
+
+/*******************************************************
+ * otp_perf_begin(): Start measuring a phase.          *
+ ******************************************************/
+void otp_perf_begin(void) {
+    if (totals == NULL || failed) {
+        return;
+    }
+    if (groupFd < 0 && openCounters() < 0) {
+        failed = 1;
+        return;
+    }
+    if (read(groupFd, &start, sizeof(start)) != sizeof(start)) {
+        failed = 1;
+    }
+}
+
+/*******************************************************
+ * otp_perf_end(): Stop measuring a phase that went    *
+ *                 over bytes bytes of a request of    *
+ *                 requestLength bytes, and add the    *
+ *                 counts to the shared totals.        *
+ ******************************************************/
+void otp_perf_end(int phase, uint64_t requestLength, size_t bytes) {
+    struct groupRead end;
+    struct perfTotals *entry;
+    int i, bucket;
+
+    if (totals == NULL || failed) {
+        return;
+    }
+    if (read(groupFd, &end, sizeof(end)) != sizeof(end)) {
+        return;
+    }
+    bucket = otp_size_class(requestLength);
+    entry = &totals[bucket][phase];
+
+    __atomic_fetch_add(&entry->samples, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&entry->bytes, bytes, __ATOMIC_RELAXED);
+    for (i = 0; i < NUM_EVENTS; i++) {
+        __atomic_fetch_add(&entry->count[i], end.values[i] - start.values[i], __ATOMIC_RELAXED);
+    }
+}
+
+/*******************************************************
+ * otp_perf_dump(): Print the totals per bucket and    *
+ *                  phase.                             *
+ ******************************************************/
+void otp_perf_dump(FILE *out, const char *name) {
+    struct perfTotals entry;
+    int bucket, phase, i;
+
+    if (totals == NULL) {
+        return;
+    }
+    fprintf(out, "%s performance counters:\n", name);
+    fprintf(out, "%-8s %-10s %10s %14s %10s %6s %14s %15s\n", "bucket", "phase", "samples",
+            "bytes", "cycles/B", "IPC", "cache-miss/KB", "branch-miss/KB");
+
+    for (bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        for (phase = 0; phase < NUM_PHASES; phase++) {
+            // Take a snapshot, the workers keep adding to it.
+            entry.samples = __atomic_load_n(&totals[bucket][phase].samples, __ATOMIC_RELAXED);
+            entry.bytes = __atomic_load_n(&totals[bucket][phase].bytes, __ATOMIC_RELAXED);
+            for (i = 0; i < NUM_EVENTS; i++) {
+                entry.count[i] = __atomic_load_n(&totals[bucket][phase].count[i], __ATOMIC_RELAXED);
+            }
+            if (entry.samples == 0 || entry.bytes == 0) {
+                continue;
+            }
+            fprintf(out, "%-8s %-10s %10llu %14llu %10.2f %6.2f %14.2f %15.2f\n",
+                    bucketName[bucket], phaseName[phase],
+                    (unsigned long long) entry.samples, (unsigned long long) entry.bytes,
+                    (double) entry.count[0] / entry.bytes,
+                    entry.count[0] ? (double) entry.count[1] / entry.count[0] : 0.0,
+                    (double) entry.count[2] * 1024 / entry.bytes,
+                    (double) entry.count[3] * 1024 / entry.bytes);
+        }
+    }
+    fflush(out);
+}
@@ -0,0 +1,38 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_perf.h                                                *
+ **                                                                        *
+ ** Description: Hardware performance counter profiling for the daemons    *
+ **              (opt-in with -P). Cycles, instructions, cache misses and  *
+ **              branch misses are measured with perf_event_open() around  *
+ **              the validate, transform and key expansion phases of every *
+ **              chunk, and added up per payload-size bucket in memory     *
+ **              shared by all the workers. Sending SIGUSR1 to the daemon  *
+ **              prints the totals.                                        *
+ **************************************************************************/
+
+#ifndef OTP_PERF_H
+#define OTP_PERF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Phases of a request that are measured.
+#define OTP_PHASE_VALIDATE 0
+#define OTP_PHASE_TRANSFORM 1
+#define OTP_PHASE_EXPAND 2
+
+// Payload-size classes, by declared request length.
+#define OTP_SIZE_CLASSES 5
+
+int otp_perf_enable(void);
+void otp_perf_begin(void);
+void otp_perf_end(int phase, uint64_t requestLength, size_t bytes);
+void otp_perf_dump(FILE *out, const char *name);
+
+int otp_size_class(uint64_t requestLength);
+const char *otp_size_class_name(int sizeClass);
+
+#endif
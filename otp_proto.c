@@ -0,0 +1,273 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_proto.c                                               *
+ **                                                                        *
+ ** Description: Helpers for the OTP wire protocol (see otp_proto.h).      *
+ **              They are shared by the daemons and by libotpclient.       *
+ **************************************************************************/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "otp_proto.h"
+
+/*******************************************************
+ * otp_read_full(): Read exactly len bytes. Returns    *
+ *                  len, 0 on end of file before the   *
+ *                  first byte, or -1 on error or on a *
+ *                  truncated read.                    *
+ ******************************************************/
+ssize_t otp_read_full(int fd, void *buf, size_t len) {
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = read(fd, (char *) buf + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return (n == 0 && done == 0) ? 0 : -1;
+        }
+        done += n;
+    }
+    return done;
+}
+
+/*******************************************************
+ * otp_write_full(): Write exactly len bytes. Returns  *
+ *                   0 on success, -1 on error.        *
+ ******************************************************/
+int otp_write_full(int fd, const void *buf, size_t len) {
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = write(fd, (const char *) buf + done, len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/*******************************************************
+ * otp_writev_full(): Write all the buffers of iov to  *
+ *                    a socket in as few system calls  *
+ *                    as possible. The iov array is    *
+ *                    consumed. A closed connection    *
+ *                    fails with EPIPE, not SIGPIPE.   *
+ ******************************************************/
+int otp_writev_full(int fd, struct iovec *iov, int count) {
+    struct msghdr msg;
+    ssize_t n;
+
+    while (count > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        // Skip over whatever was written.
+        while (count > 0 && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************
+ * otp_read_string(): Read a NUL terminated handshake  *
+ *                    string of at most size bytes.    *
+ *                    Returns 0 on success, -1 if the  *
+ *                    string is too long or truncated. *
+ ******************************************************/
+int otp_read_string(int fd, char *buf, size_t size) {
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (otp_read_full(fd, &buf[i], 1) != 1) {
+            return -1;
+        }
+        if (buf[i] == '\0') {
+            return 0;
+        }
+    }
+    buf[size - 1] = '\0';
+    return -1;
+}
+
+/*******************************************************
+ * otp_pack_request(): Fill in a request header ready  *
+ *                     to go on the wire.              *
+ ******************************************************/
+void otp_pack_request(struct otp_request *request, uint32_t mode, uint32_t flags, uint64_t length) {
+    request->mode = htonl(mode);
+    request->flags = htonl(flags);
+    request->lengthHigh = htonl((uint32_t) (length >> 32));
+    request->lengthLow = htonl((uint32_t) length);
+}
+
+/*******************************************************
+ * otp_send_request(): Send a request header.          *
+ ******************************************************/
+int otp_send_request(int fd, uint32_t mode, uint64_t length) {
+    struct otp_request request;
+
+    otp_pack_request(&request, mode, 0, length);
+    return otp_write_full(fd, &request, sizeof(request));
+}
+
+/*******************************************************
+ * otp_send_request_fds(): Send a request header along *
+ *                         with numFds file            *
+ *                         descriptors (Unix-domain    *
+ *                         sockets only).              *
+ ******************************************************/
+int otp_send_request_fds(int fd, uint32_t mode, uint32_t flags, uint64_t length,
+                         const int *fds, int numFds) {
+    struct otp_request request;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * OTP_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    ssize_t n;
+
+    if (numFds < 1 || numFds > OTP_MAX_FDS) {
+        return -1;
+    }
+    otp_pack_request(&request, mode, flags, length);
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * numFds);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * numFds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * numFds);
+
+    // The descriptors go with the first byte, the rest of the
+    // header can follow in plain writes.
+    do {
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        return -1;
+    }
+    return otp_write_full(fd, (char *) &request + n, sizeof(request) - n);
+}
+
+/*******************************************************
+ * otp_recv_request(): Receive a request header, and   *
+ *                     the file descriptors that came  *
+ *                     with it (up to OTP_MAX_FDS, the *
+ *                     count goes in numFds). Returns  *
+ *                     1 on success, 0 when the client *
+ *                     closed the connection, -1 on    *
+ *                     error.                          *
+ ******************************************************/
+int otp_recv_request(int fd, uint32_t *mode, uint32_t *flags, uint64_t *length,
+                     int *fds, int *numFds) {
+    struct otp_request request;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * OTP_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+    int received[OTP_MAX_FDS];
+    int i, count;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &request;
+    iov.iov_len = sizeof(request);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+
+    *numFds = 0;
+    if (n <= 0) {
+        return n;
+    }
+    // Keep the descriptors, even when the header turns out to be bad,
+    // so the caller always knows what to close.
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(received, CMSG_DATA(cmsg), sizeof(int) * count);
+        for (i = 0; i < count; i++) {
+            fds[(*numFds)++] = received[i];
+        }
+    }
+    if ((size_t) n < sizeof(request)
+            && otp_read_full(fd, (char *) &request + n, sizeof(request) - n) <= 0) {
+        return -1;
+    }
+    *mode = ntohl(request.mode);
+    *flags = ntohl(request.flags);
+    *length = ((uint64_t) ntohl(request.lengthHigh) << 32) | ntohl(request.lengthLow);
+    return 1;
+}
+
+/*******************************************************
+ * otp_checksum(): Update the Adler-32 checksum sum    *
+ *                 (1 to start) with len more bytes.   *
+ ******************************************************/
+uint32_t otp_checksum(uint32_t sum, const char *buf, size_t len) {
+    const unsigned char *bytes = (const unsigned char *) buf;
+    uint32_t a = sum & 0xffff;
+    uint32_t b = sum >> 16;
+    size_t run;
+
+    while (len > 0) {
+        // Largest run that can't overflow b before the modulo.
+        run = len < 5552 ? len : 5552;
+        len -= run;
+        while (run-- > 0) {
+            a += *bytes++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
@@ -0,0 +1,120 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_proto.h                                               *
+ **                                                                        *
+ ** Description: Wire protocol spoken between the OTP clients and daemons. *
+ **                                                                        *
+ **              1. The client sends its name ("enc_bs" or "dec_bs") as a  *
+ **                 NUL terminated string and the daemon answers with its  *
+ **                 own ("enc_d_bs" or "dec_d_bs"), or "invalid" before    *
+ **                 closing the connection.                                *
+ **              2. Any number of requests follow on the same connection.  *
+ **                 Each one starts with a struct otp_request header, and  *
+ **                 then the payload travels in chunks of OTP_CHUNK bytes  *
+ **                 at most: the client sends a chunk of text followed by  *
+ **                 the same number of key characters, and the daemon      *
+ **                 answers with one status byte and, when the status is   *
+ **                 OTP_OK, the transformed chunk.                         *
+ **              3. The client closes the connection when it is done.      *
+ **                                                                        *
+ **              A request with OTP_FLAG_RESUMABLE is answered with a      *
+ **              status byte and a struct otp_job before the first chunk.  *
+ **              After a dropped connection, the client sends the same     *
+ **              header with OTP_FLAG_RESUME instead, followed by a struct  *
+ **              otp_resume. The daemon answers with a status byte, and on *
+ **              OTP_OK the chunks go on from the offset the client gave.  *
+ **              See otp_jobs.h.                                           *
+ **                                                                        *
+ **              On the Unix-domain socket, a request with OTP_FLAG_FILES  *
+ **              carries no payload. The text, key and output file         *
+ **              descriptors travel with its header (SCM_RIGHTS) instead,  *
+ **              and the daemon answers with a single status byte once it  *
+ **              has written the result to the output file descriptor.     *
+ **************************************************************************/
+
+#ifndef OTP_PROTO_H
+#define OTP_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Largest chunk of text (and of key) sent in one go.
+#define OTP_CHUNK 65536
+
+// Longest handshake string.
+#define OTP_NAME_MAX 16
+
+// Most file descriptors passed along with a request.
+#define OTP_MAX_FDS 3
+
+// Request modes. The text modes each have an alphabet (see otp_kernel.h).
+#define OTP_MODE_TEXT 0     // 'A'-'Z' and space, mod 27 arithmetic.
+#define OTP_MODE_BINARY 1   // any byte, XOR with the key.
+#define OTP_MODE_BASE32 2   // 'A'-'Z' and '2'-'7', mod 32.
+#define OTP_MODE_ALNUM 3    // digits and letters, mod 62.
+#define OTP_MODE_PRINT 4    // printable ASCII, mod 95.
+
+// Status byte sent back for every chunk.
+#define OTP_OK 0            // chunk transformed, data follows.
+#define OTP_BAD_TEXT 1      // the text contains bad characters.
+#define OTP_BAD_KEY 2       // the key contains bad characters.
+#define OTP_BAD_REQUEST 3   // mode not supported by the daemon.
+#define OTP_SHORT_KEY 4     // the key file is shorter than the text.
+#define OTP_BAD_FILE 5      // a file passed with OTP_FLAG_FILES is unusable.
+#define OTP_BAD_RESUME 6    // the job cannot be resumed from that offset.
+
+// Request flags.
+#define OTP_FLAG_FILES 1    // text, key and output fds come with the header.
+#define OTP_FLAG_RESUMABLE 2 // start a job that can be resumed.
+#define OTP_FLAG_RESUME 4   // resume a job, a struct otp_resume follows.
+#define OTP_FLAG_SEED 8     // no key is sent, a struct otp_seed follows.
+
+// Request header. Every field travels in network byte order.
+struct otp_request {
+    uint32_t mode;          // one of the OTP_MODE_* values.
+    uint32_t flags;         // OTP_FLAG_* bits.
+    uint32_t lengthHigh;    // payload length, upper 32 bits.
+    uint32_t lengthLow;     // payload length, lower 32 bits.
+};
+
+// Job ID given back for a OTP_FLAG_RESUMABLE request.
+struct otp_job {
+    uint32_t idHigh;
+    uint32_t idLow;         // 0 if the daemon can't resume jobs.
+};
+
+// Sent right after a OTP_FLAG_SEED header. The daemon derives the key
+// from the seed (see otp_kernel.h), and the chunks only carry text.
+struct otp_seed {
+    unsigned char seed[44]; // ChaCha20 key and nonce, as made by keygen -s.
+    uint32_t offsetHigh;    // position of the request in the key.
+    uint32_t offsetLow;
+};
+
+// Sent after a OTP_FLAG_RESUME header (and its struct otp_seed).
+struct otp_resume {
+    uint32_t idHigh;        // job ID.
+    uint32_t idLow;
+    uint32_t offsetHigh;    // output the client already has.
+    uint32_t offsetLow;
+    uint32_t checksum;      // Adler-32 of that output.
+};
+
+ssize_t otp_read_full(int fd, void *buf, size_t len);
+int otp_write_full(int fd, const void *buf, size_t len);
+int otp_writev_full(int fd, struct iovec *iov, int count);
+int otp_read_string(int fd, char *buf, size_t size);
+
+void otp_pack_request(struct otp_request *request, uint32_t mode, uint32_t flags, uint64_t length);
+int otp_send_request(int fd, uint32_t mode, uint64_t length);
+int otp_send_request_fds(int fd, uint32_t mode, uint32_t flags, uint64_t length,
+                         const int *fds, int numFds);
+int otp_recv_request(int fd, uint32_t *mode, uint32_t *flags, uint64_t *length,
+                     int *fds, int *numFds);
+
+uint32_t otp_checksum(uint32_t sum, const char *buf, size_t len);
+
+#endif
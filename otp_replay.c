@@ -0,0 +1,724 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_replay.c                                              *
+ **                                                                        *
+ ** Description: Plays a capture log (see otp_capture.h) back against a    *
+ **              daemon of the kind that made it, and compares the         *
+ **              latencies with the captured ones, per size class.         *
+ **                                                                        *
+ **              Every captured connection is opened again, at the time it *
+ **              was accepted, and its requests are sent over it in order  *
+ **              at the time they arrived: the same mode, the same number  *
+ **              of bytes, and the logged text and key when the log has    *
+ **              them (-C), or else random symbols of the alphabet. Seeded *
+ **              requests get a fresh seed. Requests that passed files are *
+ **              passed files again (memfds) when the target is the        *
+ **              Unix-domain socket. Resumable requests are replayed as    *
+ **              plain ones, for the bytes that were processed.            *
+ **                                                                        *
+ **              The captured latency runs from the arrival of the header  *
+ **              to the last write of the answer, the replayed one from    *
+ **              sending the header to reading the end of the answer, so   *
+ **              the replayed one also holds a round trip.                 *
+ **                                                                        *
+ **              Usage: otp_replay [-m | -r rate] [-j conns] log           *
+ **                                port|socket                             *
+ **                -m  max speed: send everything as soon as possible.     *
+ **                -r  speed relative to the capture, 2 for twice as fast. *
+ **                -j  most connections open at the same time.             *
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "otp_capture.h"
+#include "otp_client.h"
+#include "otp_kernel.h"
+#include "otp_perf.h"
+#include "otp_proto.h"
+
+#define NUM_MODES (OTP_MODE_PRINT + 1)
+#define DEFAULT_CONNS 64
+#define THREAD_STACK (256 * 1024)
+
+// Replay status of a request that couldn't be sent.
+#define NOT_SENT -1
+
+// A request read from the log.
+struct request {
+    uint64_t conn;              // connection it came on.
+    uint64_t seq;               // position in the log.
+    uint64_t start;             // arrival, in ns since the epoch.
+    uint64_t latency;           // captured latency, in ns.
+    uint64_t bytes;             // bytes of text processed.
+    uint32_t mode;
+    uint32_t flags;
+    uint32_t status;
+    size_t firstChunk;          // its payload in chunks[].
+    size_t numChunks;
+    uint64_t replayLatency;     // replayed latency, in ns.
+    uint64_t lag;               // how late it was sent, in ns.
+    int replayStatus;           // status it got, or NOT_SENT.
+};
+
+// A payload chunk in the log.
+struct chunk {
+    uint64_t conn;
+    uint64_t seq;
+    off_t offset;               // where its text starts, its key follows.
+    uint32_t textLength;
+    uint32_t keyLength;
+};
+
+// A connection and its requests, in order.
+struct connection {
+    uint64_t time;              // accepted, in ns since the epoch.
+    size_t first;
+    size_t count;
+};
+
+// The log.
+static int logFd;
+static int which;
+static struct request *requests;
+static size_t numRequests;
+static struct chunk *chunks;
+static size_t numChunks;
+static struct connection *conns;
+static size_t numConns;
+
+// Replay settings and state shared by the connection threads.
+static const char *unixPath = NULL;
+static int portno;
+static double rate = 1.0;           // 0 for max speed.
+static uint64_t origin;             // first connection of the log.
+static uint64_t span;               // time from then to the last answer.
+static uint64_t replayStart;        // monotonic time the replay began.
+static sem_t openSlots;             // connections that may still open.
+static char *randomText[NUM_MODES]; // random text and key of every mode.
+static char *randomKey[NUM_MODES];
+
+/*******************************************************
+ * nowNs(): Monotonic time in nanoseconds.             *
+ ******************************************************/
+static uint64_t nowNs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*******************************************************
+ * unpack(): Read a 64-bit value stored as two 32-bit  *
+ *           fields in network byte order.             *
+ ******************************************************/
+static uint64_t unpack(uint32_t high, uint32_t low) {
+    return ((uint64_t) ntohl(high) << 32) | ntohl(low);
+}
+
+/*******************************************************
+ * byRecord(): Order records by connection, then by    *
+ *             position in the log. Both requests and  *
+ *             chunks start with those two fields.     *
+ ******************************************************/
+static int byRecord(const void *a, const void *b) {
+    const uint64_t *x = a;
+    const uint64_t *y = b;
+
+    if (x[0] != y[0]) {
+        return x[0] < y[0] ? -1 : 1;
+    }
+    return x[1] < y[1] ? -1 : x[1] > y[1];
+}
+
+/*******************************************************
+ * byValue(): Order latencies.                         *
+ ******************************************************/
+static int byValue(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*******************************************************
+ * grow(): Make room for one more element in an array  *
+ *         of count elements of size bytes.            *
+ ******************************************************/
+static void *grow(void *array, size_t count, size_t *capacity, size_t size) {
+    if (count < *capacity) {
+        return array;
+    }
+    *capacity = *capacity ? *capacity * 2 : 1024;
+    array = realloc(array, *capacity * size);
+    if (array == NULL) {
+        fprintf(stderr, "otp_replay: %s\n", otp_strerror(OTP_E_NOMEM));
+        exit(1);
+    }
+    return array;
+}
+
+/*******************************************************
+ * readLog(): Read the requests and the chunk offsets  *
+ *            of the log at path, and group them by    *
+ *            connection.                              *
+ ******************************************************/
+static void readLog(const char *path) {
+    struct otp_capture_header header;
+    struct otp_capture_request record;
+    struct otp_capture_chunk chunkRecord;
+    struct stat info;
+    size_t requestCapacity = 0, chunkCapacity = 0, connCapacity = 0;
+    size_t i, j;
+    uint64_t seq;
+    FILE *log = fopen(path, "r");
+
+    if (log == NULL || fread(&header, sizeof(header), 1, log) != 1
+            || memcmp(header.magic, OTP_CAPTURE_MAGIC, sizeof(header.magic)) != 0) {
+        printf("Error: %s is not a capture log\n", path);
+        exit(1);
+    }
+    logFd = fileno(log);
+    fstat(logFd, &info);
+    which = strcmp(header.client, "dec_bs") == 0 ? OTP_DEC : OTP_ENC;
+
+    // Requests and chunks follow in any order, the kind comes first.
+    for (seq = 0; fread(&record.kind, sizeof(record.kind), 1, log) == 1; seq++) {
+        if (ntohl(record.kind) == OTP_CAPTURE_REQUEST) {
+            if (fread((char *) &record + sizeof(record.kind),
+                      sizeof(record) - sizeof(record.kind), 1, log) != 1) {
+                break;
+            }
+            requests = grow(requests, numRequests, &requestCapacity, sizeof(*requests));
+            memset(&requests[numRequests], 0, sizeof(*requests));
+            requests[numRequests].conn = unpack(record.connHigh, record.connLow);
+            requests[numRequests].seq = seq;
+            requests[numRequests].start = unpack(record.startHigh, record.startLow);
+            requests[numRequests].latency = unpack(record.latencyHigh, record.latencyLow);
+            requests[numRequests].bytes = unpack(record.bytesHigh, record.bytesLow);
+            requests[numRequests].mode = ntohl(record.mode);
+            requests[numRequests].flags = ntohl(record.flags);
+            requests[numRequests].status = ntohl(record.status);
+            numRequests++;
+        } else if (ntohl(record.kind) == OTP_CAPTURE_CHUNK) {
+            chunkRecord.kind = record.kind;
+            if (fread((char *) &chunkRecord + sizeof(chunkRecord.kind),
+                      sizeof(chunkRecord) - sizeof(chunkRecord.kind), 1, log) != 1) {
+                break;
+            }
+            chunks = grow(chunks, numChunks, &chunkCapacity, sizeof(*chunks));
+            chunks[numChunks].conn = unpack(chunkRecord.connHigh, chunkRecord.connLow);
+            chunks[numChunks].seq = seq;
+            chunks[numChunks].offset = ftello(log);
+            chunks[numChunks].textLength = ntohl(chunkRecord.textLength);
+            chunks[numChunks].keyLength = ntohl(chunkRecord.keyLength);
+            if (chunks[numChunks].offset + chunks[numChunks].textLength
+                    + chunks[numChunks].keyLength > info.st_size
+                    || fseeko(log, chunks[numChunks].textLength + chunks[numChunks].keyLength,
+                              SEEK_CUR) < 0) {
+                break;
+            }
+            numChunks++;
+        } else {
+            break;
+        }
+    }
+    if (!feof(log)) {
+        fprintf(stderr, "otp_replay: %s is cut short, replaying what comes before\n", path);
+    }
+    if (numRequests == 0) {
+        printf("Error: %s holds no requests\n", path);
+        exit(1);
+    }
+
+    // Each connection comes out in one piece, its chunks right
+    // before the request they belong to.
+    qsort(requests, numRequests, sizeof(*requests), byRecord);
+    qsort(chunks, numChunks, sizeof(*chunks), byRecord);
+
+    for (i = 0, j = 0; i < numRequests; i++) {
+        while (j < numChunks && chunks[j].conn < requests[i].conn) {
+            j++;
+        }
+        requests[i].firstChunk = j;
+        while (j < numChunks && chunks[j].conn == requests[i].conn
+               && chunks[j].seq < requests[i].seq) {
+            j++;
+        }
+        requests[i].numChunks = j - requests[i].firstChunk;
+
+        if (i == 0 || requests[i].conn != requests[i - 1].conn) {
+            conns = grow(conns, numConns, &connCapacity, sizeof(*conns));
+            conns[numConns].time = requests[i].conn;
+            conns[numConns].first = i;
+            conns[numConns].count = 0;
+            numConns++;
+        }
+        conns[numConns - 1].count++;
+    }
+    origin = conns[0].time;
+    for (i = 0; i < numRequests; i++) {
+        if (requests[i].start + requests[i].latency - origin > span) {
+            span = requests[i].start + requests[i].latency - origin;
+        }
+    }
+}
+
+/*******************************************************
+ * makeRandom(): Fill the random text and key of every *
+ *               mode, one chunk of each.              *
+ ******************************************************/
+static void makeRandom(void) {
+    const struct otp_alphabet *alphabet;
+    char **buffers[2] = {randomText, randomKey};
+    int mode, i;
+    size_t k;
+
+    for (mode = 0; mode < NUM_MODES; mode++) {
+        alphabet = otp_alphabet(mode);
+        for (i = 0; i < 2; i++) {
+            buffers[i][mode] = malloc(OTP_CHUNK);
+            if (buffers[i][mode] == NULL) {
+                fprintf(stderr, "otp_replay: %s\n", otp_strerror(OTP_E_NOMEM));
+                exit(1);
+            }
+            getrandom(buffers[i][mode], OTP_CHUNK, 0);
+            for (k = 0; alphabet != NULL && k < OTP_CHUNK; k++) {
+                buffers[i][mode][k] = alphabet->symbols[(unsigned char) buffers[i][mode][k]
+                                                        % alphabet->size];
+            }
+        }
+    }
+}
+
+/*******************************************************
+ * payload(): Point text and key at chunk number index *
+ *            of a request: the logged one read into   *
+ *            the buffers when the log has it, random  *
+ *            data of its mode otherwise.              *
+ ******************************************************/
+static void payload(const struct request *r, size_t index, size_t length, char *textBuffer,
+                    char *keyBuffer, const char **text, const char **key) {
+    const struct chunk *c = index < r->numChunks ? &chunks[r->firstChunk + index] : NULL;
+    int mode = r->mode < NUM_MODES ? r->mode : OTP_MODE_TEXT;
+
+    *text = randomText[mode];
+    *key = randomKey[mode];
+    if (c != NULL && c->textLength == length
+            && pread(logFd, textBuffer, length, c->offset) == (ssize_t) length) {
+        *text = textBuffer;
+    }
+    if (c != NULL && c->keyLength == length
+            && pread(logFd, keyBuffer, length, c->offset + length) == (ssize_t) length) {
+        *key = keyBuffer;
+    }
+}
+
+/*******************************************************
+ * waitFor(): Sleep until the replay of what happened  *
+ *            at time (ns since the epoch) is due, and *
+ *            return how late that is.                 *
+ ******************************************************/
+static uint64_t waitFor(uint64_t time) {
+    struct timespec due;
+    uint64_t dueNs, now;
+
+    if (rate == 0 || time <= origin) {
+        return 0;
+    }
+    dueNs = replayStart + (uint64_t) ((time - origin) / rate);
+    due.tv_sec = dueNs / 1000000000;
+    due.tv_nsec = dueNs % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+        continue;
+    }
+    now = nowNs();
+    return now > dueNs ? now - dueNs : 0;
+}
+
+/*******************************************************
+ * sendRequest(): Send a request over the connection,  *
+ *                chunk by chunk, and read the answer. *
+ *                Returns its last status, or NOT_SENT *
+ *                if the connection failed.            *
+ ******************************************************/
+static int sendRequest(int sockfd, const struct request *r, char *textBuffer, char *keyBuffer,
+                       char *out) {
+    struct otp_request header;
+    struct otp_seed seed;
+    struct iovec iov[2];
+    const char *text, *key;
+    unsigned char status;
+    uint64_t offset;
+    size_t length, index;
+    int seeded = r->flags & OTP_FLAG_SEED;
+
+    otp_pack_request(&header, r->mode, seeded, r->bytes);
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    if (seeded) {
+        getrandom(seed.seed, sizeof(seed.seed), 0);
+        seed.offsetHigh = seed.offsetLow = 0;
+        iov[1].iov_base = &seed;
+        iov[1].iov_len = sizeof(seed);
+    }
+    if (otp_writev_full(sockfd, iov, seeded ? 2 : 1) < 0) {
+        return NOT_SENT;
+    }
+    for (offset = 0, index = 0; offset < r->bytes; offset += length, index++) {
+        length = r->bytes - offset < OTP_CHUNK ? r->bytes - offset : OTP_CHUNK;
+
+        payload(r, index, length, textBuffer, keyBuffer, &text, &key);
+        iov[0].iov_base = (void *) text;
+        iov[0].iov_len = length;
+        iov[1].iov_base = (void *) key;
+        iov[1].iov_len = length;
+        if (otp_writev_full(sockfd, iov, seeded ? 1 : 2) < 0
+                || otp_read_full(sockfd, &status, 1) != 1) {
+            return NOT_SENT;
+        }
+        if (status != OTP_OK) {
+            return status;
+        }
+        if (otp_read_full(sockfd, out, length) != (ssize_t) length) {
+            return NOT_SENT;
+        }
+    }
+    // An empty request is only answered when it fails.
+    if (r->bytes == 0 && r->status != OTP_OK) {
+        return otp_read_full(sockfd, &status, 1) == 1 ? status : NOT_SENT;
+    }
+    return OTP_OK;
+}
+
+/*******************************************************
+ * fillFiles(): Write the text and key of a request    *
+ *              into the memfds passed to the daemon,  *
+ *              and empty its output.                  *
+ ******************************************************/
+static int fillFiles(const struct request *r, const int fds[3], char *textBuffer,
+                     char *keyBuffer) {
+    const char *text, *key;
+    uint64_t offset;
+    size_t length, index;
+    char seed[OTP_SEED_SIZE];
+
+    if (ftruncate(fds[0], 0) < 0 || ftruncate(fds[1], 0) < 0 || ftruncate(fds[2], 0) < 0) {
+        return -1;
+    }
+    for (offset = 0, index = 0; offset < r->bytes; offset += length, index++) {
+        length = r->bytes - offset < OTP_CHUNK ? r->bytes - offset : OTP_CHUNK;
+
+        payload(r, index, length, textBuffer, keyBuffer, &text, &key);
+        if (pwrite(fds[0], text, length, offset) != (ssize_t) length
+                || (!(r->flags & OTP_FLAG_SEED)
+                    && pwrite(fds[1], key, length, offset) != (ssize_t) length)) {
+            return -1;
+        }
+    }
+    if (r->flags & OTP_FLAG_SEED) {
+        getrandom(seed, sizeof(seed), 0);
+        if (pwrite(fds[1], seed, sizeof(seed), 0) != sizeof(seed)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************
+ * sendFiles(): Pass the files of a request to the     *
+ *              daemon. Returns its status, or         *
+ *              NOT_SENT if the connection failed.     *
+ ******************************************************/
+static int sendFiles(int sockfd, const struct request *r, const int fds[3]) {
+    int flags = r->mode | ((r->flags & OTP_FLAG_SEED) ? OTP_SEEDED : 0);
+    size_t keylen = (r->flags & OTP_FLAG_SEED) ? OTP_SEED_SIZE : r->bytes;
+    int result;
+
+    if (which == OTP_ENC) {
+        result = otp_encrypt_files(sockfd, flags, fds[0], r->bytes, fds[1], keylen, fds[2]);
+    } else {
+        result = otp_decrypt_files(sockfd, flags, fds[0], r->bytes, fds[1], keylen, fds[2]);
+    }
+    switch (result) {
+    case 0:
+        return OTP_OK;
+    case OTP_E_TEXT:
+        return OTP_BAD_TEXT;
+    case OTP_E_KEY:
+        return OTP_BAD_KEY;
+    case OTP_E_SHORTKEY:
+        return OTP_SHORT_KEY;
+    case OTP_E_MODE:
+        return OTP_BAD_REQUEST;
+    case OTP_E_FILE:
+        return OTP_BAD_FILE;
+    default:
+        return NOT_SENT;
+    }
+}
+
+/*******************************************************
+ * replayConnection(): Thread replaying the requests   *
+ *                     of one connection.              *
+ ******************************************************/
+static void *replayConnection(void *arg) {
+    struct connection *conn = arg;
+    struct request *r;
+    char *textBuffer = malloc(OTP_CHUNK);
+    char *keyBuffer = malloc(OTP_CHUNK);
+    char *out = malloc(OTP_CHUNK);
+    int fds[3] = {-1, -1, -1};
+    int sockfd = -1;
+    int files;
+    uint64_t sent;
+    size_t i;
+
+    waitFor(conn->time);
+    for (i = 0; i < conn->count; i++) {
+        r = &requests[conn->first + i];
+        r->replayStatus = NOT_SENT;
+        files = unixPath != NULL && (r->flags & OTP_FLAG_FILES);
+
+        if (r->status == OTP_CAPTURE_DROPPED || textBuffer == NULL || keyBuffer == NULL
+                || out == NULL) {
+            continue;
+        }
+        // The daemon hangs up after most errors, so the next
+        // request on the connection needs a new one.
+        if (sockfd < 0) {
+            sockfd = unixPath != NULL ? otp_connect_unix(unixPath, which)
+                                      : otp_connect("localhost", portno, which);
+            if (sockfd < 0) {
+                continue;
+            }
+        }
+        if (files && fds[0] < 0) {
+            fds[0] = memfd_create("otp_replay_text", MFD_CLOEXEC);
+            fds[1] = memfd_create("otp_replay_key", MFD_CLOEXEC);
+            fds[2] = memfd_create("otp_replay_out", MFD_CLOEXEC);
+        }
+        if (files && fillFiles(r, fds, textBuffer, keyBuffer) < 0) {
+            continue;
+        }
+        r->lag = waitFor(r->start);
+        sent = nowNs();
+        if (files) {
+            r->replayStatus = sendFiles(sockfd, r, fds);
+        } else {
+            r->replayStatus = sendRequest(sockfd, r, textBuffer, keyBuffer, out);
+        }
+        r->replayLatency = nowNs() - sent;
+
+        if (r->replayStatus != OTP_OK) {
+            close(sockfd);
+            sockfd = -1;
+        }
+    }
+    if (sockfd >= 0) {
+        close(sockfd);
+    }
+    for (i = 0; i < 3; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+    free(textBuffer);
+    free(keyBuffer);
+    free(out);
+    sem_post(&openSlots);
+    return NULL;
+}
+
+/*******************************************************
+ * percentile(): Latency below which the given         *
+ *               fraction of the sorted ones fall, in  *
+ *               microseconds.                         *
+ ******************************************************/
+static double percentile(const uint64_t *sorted, size_t count, double fraction) {
+    size_t rank = (size_t) (count * fraction + 0.5);
+
+    if (rank > 0) {
+        rank--;
+    }
+    return sorted[rank < count ? rank : count - 1] / 1000.0;
+}
+
+/*******************************************************
+ * printClass(): Print the captured and the replayed   *
+ *               latencies of the requests of a class. *
+ ******************************************************/
+static void printClass(const char *name, uint64_t *captured, uint64_t *replayed, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    qsort(captured, count, sizeof(*captured), byValue);
+    qsort(replayed, count, sizeof(*replayed), byValue);
+    printf("%-8s %9zu %10.0f %10.0f %10.0f %10.0f %10.0f %10.0f %+8.1f%%\n", name, count,
+           percentile(captured, count, 0.50), percentile(captured, count, 0.99),
+           captured[count - 1] / 1000.0,
+           percentile(replayed, count, 0.50), percentile(replayed, count, 0.99),
+           replayed[count - 1] / 1000.0,
+           100.0 * (percentile(replayed, count, 0.50) - percentile(captured, count, 0.50))
+                 / (percentile(captured, count, 0.50) > 0 ? percentile(captured, count, 0.50) : 1));
+}
+
+/*******************************************************
+ * report(): Compare the replayed requests with the    *
+ *           captured ones. Returns how many could not *
+ *           be sent.                                  *
+ ******************************************************/
+static size_t report(uint64_t elapsed) {
+    uint64_t *captured[OTP_SIZE_CLASSES + 1];
+    uint64_t *replayed[OTP_SIZE_CLASSES + 1];
+    size_t count[OTP_SIZE_CLASSES + 1] = {0};
+    size_t dropped = 0, failed = 0, differ = 0;
+    uint64_t lagTotal = 0, lagMax = 0;
+    struct request *r;
+    size_t i;
+    int c;
+
+    for (c = 0; c <= OTP_SIZE_CLASSES; c++) {
+        captured[c] = malloc(numRequests * sizeof(uint64_t));
+        replayed[c] = malloc(numRequests * sizeof(uint64_t));
+        if (captured[c] == NULL || replayed[c] == NULL) {
+            fprintf(stderr, "otp_replay: %s\n", otp_strerror(OTP_E_NOMEM));
+            exit(1);
+        }
+    }
+    for (i = 0; i < numRequests; i++) {
+        r = &requests[i];
+        if (r->status == OTP_CAPTURE_DROPPED) {
+            dropped++;
+            continue;
+        }
+        if (r->replayStatus == NOT_SENT) {
+            failed++;
+            continue;
+        }
+        lagTotal += r->lag;
+        lagMax = r->lag > lagMax ? r->lag : lagMax;
+        if ((uint32_t) r->replayStatus != r->status) {
+            differ++;
+            continue;
+        }
+        // Only the requests that went the same way are compared.
+        c = otp_size_class(r->bytes);
+        captured[c][count[c]] = r->latency;
+        replayed[c][count[c]++] = r->replayLatency;
+        captured[OTP_SIZE_CLASSES][count[OTP_SIZE_CLASSES]] = r->latency;
+        replayed[OTP_SIZE_CLASSES][count[OTP_SIZE_CLASSES]++] = r->replayLatency;
+    }
+
+    printf("Replayed %zu requests on %zu connections in %.3f s", numRequests - dropped - failed,
+           numConns, elapsed / 1e9);
+    if (rate == 0) {
+        printf(" at max speed");
+    } else {
+        printf(" at %gx (captured over %.3f s)", rate, span / 1e9);
+    }
+    printf("\n");
+    printf("%zu dropped in the capture, %zu not sent, %zu ended otherwise\n", dropped, failed,
+           differ);
+    if (numRequests - dropped - failed > 0) {
+        printf("sent late by %.0f us on average, %.0f us at most\n",
+               lagTotal / 1000.0 / (numRequests - dropped - failed), lagMax / 1000.0);
+    }
+    printf("%-8s %9s %10s %10s %10s %10s %10s %10s %9s\n", "class", "requests", "cap-p50",
+           "cap-p99", "cap-max", "rep-p50", "rep-p99", "rep-max", "p50-diff");
+    for (c = 0; c < OTP_SIZE_CLASSES; c++) {
+        printClass(otp_size_class_name(c), captured[c], replayed[c], count[c]);
+    }
+    printClass("all", captured[OTP_SIZE_CLASSES], replayed[OTP_SIZE_CLASSES],
+               count[OTP_SIZE_CLASSES]);
+    printf("(latencies in us)\n");
+
+    for (c = 0; c <= OTP_SIZE_CLASSES; c++) {
+        free(captured[c]);
+        free(replayed[c]);
+    }
+    return failed;
+}
+
+// Main body.
+int main(int argc, char *argv[]) {
+
+    // Declare variables.
+    int option;
+    int maxConns = DEFAULT_CONNS;
+    size_t i;
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    // -m and -r set the speed, -j the most connections at once.
+    while ((option = getopt(argc, argv, "j:mr:")) != -1) {
+        switch (option) {
+        case 'j':
+            maxConns = atoi(optarg);
+            break;
+        case 'm':
+            rate = 0;
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        default:
+            printf("Usage: otp_replay [-m | -r rate] [-j conns] log port|socket\n");
+            exit(1);
+        }
+    }
+    if (argc - optind != 2 || maxConns <= 0 || rate < 0) {
+        printf("Usage: otp_replay [-m | -r rate] [-j conns] log port|socket\n");
+        exit(1);
+    }
+    // A path (anything with a '/') instead of a port means the daemon
+    // runs on this host and listens on that Unix-domain socket.
+    if (strchr(argv[optind + 1], '/') != NULL) {
+        unixPath = argv[optind + 1];
+    } else {
+        portno = atoi(argv[optind + 1]);
+    }
+    readLog(argv[optind]);
+    makeRandom();
+
+    // Open every connection when it is due, as long as there is room.
+    sem_init(&openSlots, 0, maxConns);
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    replayStart = nowNs();
+
+    for (i = 0; i < numConns; i++) {
+        waitFor(conns[i].time);
+        while (sem_wait(&openSlots) < 0) {
+            continue;
+        }
+        if (pthread_create(&thread, &attr, replayConnection, &conns[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    // Wait for the last ones to finish.
+    for (i = 0; i < (size_t) maxConns; i++) {
+        while (sem_wait(&openSlots) < 0) {
+            continue;
+        }
+    }
+    // Requests that couldn't be sent are network errors.
+    if (report(nowNs() - replayStart) > 0) {
+        return 2;
+    }
+    return 0;
+}
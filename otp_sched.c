@@ -0,0 +1,372 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_sched.c                                               *
+ **                                                                        *
+ ** Description: Size-aware scheduling of the workers (see otp_sched.h).   *
+ **              The slots, the waiting line and the statistics live in a  *
+ **              shared mapping guarded by a process-shared, robust mutex, *
+ **              so a worker killed while holding it doesn't wedge the     *
+ **              others. The parent frees whatever a dead worker held.     *
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "otp_perf.h"
+#include "otp_sched.h"
+
+// Waiting times are counted in power of two buckets of microseconds.
+#define HISTOGRAM_SIZE 40
+
+// A worker waiting for a slot.
+struct waiter {
+    pid_t pid;                  // 0 when the entry is free.
+    uint64_t remaining;         // bytes left in its request.
+    uint64_t since;             // when its request arrived.
+};
+
+// Queueing delay of the requests of one size class.
+struct classDelay {
+    uint64_t requests;
+    uint64_t totalUs;
+    uint64_t maxUs;
+    uint64_t histogram[HISTOGRAM_SIZE];
+};
+
+// Everything shared by the workers.
+struct schedState {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int slots;                  // chunks processed at the same time.
+    int numRunning;             // slots in use.
+    int numWaiting;             // entries in use in waiters.
+    pid_t chosen;               // waiter handed the next free slot, or 0.
+    pid_t running[OTP_SCHED_MAX_SLOTS];
+    struct waiter waiters[OTP_SCHED_MAX_WAITERS];
+    struct classDelay delay[OTP_SIZE_CLASSES];
+};
+
+static struct schedState *state = NULL;
+static int slot = -1;               // slot held by this worker, or -1.
+static uint64_t requestStart = 0;   // arrival of the current request.
+static uint64_t waited = 0;         // microseconds it waited so far.
+
+/*******************************************************
+ * nowUs(): Monotonic time in microseconds.            *
+ ******************************************************/
+static uint64_t nowUs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/*******************************************************
+ * lockState(): Take the lock, and take it over from   *
+ *              a worker that died holding it.         *
+ ******************************************************/
+static void lockState(void) {
+    if (pthread_mutex_lock(&state->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&state->lock);
+    }
+}
+
+/*******************************************************
+ * waitState(): Wait for a slot to be given back.      *
+ ******************************************************/
+static void waitState(void) {
+    if (pthread_cond_wait(&state->wake, &state->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&state->lock);
+    }
+}
+
+/*******************************************************
+ * nextWaiter(): Return the waiter to serve next: the  *
+ *               one with the fewest bytes left, each  *
+ *               halved for every OTP_SCHED_AGING_US   *
+ *               its request has been around.          *
+ ******************************************************/
+static struct waiter *nextWaiter(uint64_t now) {
+    struct waiter *best = NULL;
+    uint64_t age, key, bestKey = 0;
+    int i;
+
+    for (i = 0; i < OTP_SCHED_MAX_WAITERS; i++) {
+        if (state->waiters[i].pid == 0) {
+            continue;
+        }
+        age = (now - state->waiters[i].since) / OTP_SCHED_AGING_US;
+        key = age >= 64 ? 0 : state->waiters[i].remaining >> age;
+
+        if (best == NULL || key < bestKey || (key == bestKey && state->waiters[i].since < best->since)) {
+            best = &state->waiters[i];
+            bestKey = key;
+        }
+    }
+    return best;
+}
+
+/*******************************************************
+ * chooseNext(): Hand a free slot to the waiter to     *
+ *               serve next and wake it up. The choice *
+ *               is made once, here: the aging changes *
+ *               the order as time goes by, so waiters *
+ *               picking among themselves could each   *
+ *               find another one first and all sleep  *
+ *               with the slots free.                  *
+ ******************************************************/
+static void chooseNext(void) {
+    struct waiter *next;
+
+    if (state->chosen != 0 || state->numRunning >= state->slots || state->numWaiting == 0) {
+        return;
+    }
+    next = nextWaiter(nowUs());
+    if (next != NULL) {
+        state->chosen = next->pid;
+        pthread_cond_broadcast(&state->wake);
+    }
+}
+
+/*******************************************************
+ * otp_sched_enable(): Turn scheduling on with slots   *
+ *                     slots. It must be called before *
+ *                     the workers are forked. Zero    *
+ *                     slots leaves it off. Returns -1 *
+ *                     on failure.                     *
+ ******************************************************/
+int otp_sched_enable(int slots) {
+    pthread_mutexattr_t mutexAttr;
+    pthread_condattr_t condAttr;
+    void *memory;
+
+    if (slots <= 0) {
+        return 0;
+    }
+    memory = mmap(NULL, sizeof(struct schedState), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return -1;
+    }
+    state = memory;
+    state->slots = slots < OTP_SCHED_MAX_SLOTS ? slots : OTP_SCHED_MAX_SLOTS;
+
+    pthread_mutexattr_init(&mutexAttr);
+    pthread_mutexattr_setpshared(&mutexAttr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mutexAttr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&state->lock, &mutexAttr);
+    pthread_mutexattr_destroy(&mutexAttr);
+
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setpshared(&condAttr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&state->wake, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+    return 0;
+}
+
+/*******************************************************
+ * otp_sched_admit(): Wait for a slot to process the   *
+ *                    next chunk of a request that has *
+ *                    remaining bytes left.            *
+ ******************************************************/
+void otp_sched_admit(uint64_t remaining) {
+    struct waiter *me = NULL;
+    pid_t pid = getpid();
+    uint64_t start;
+    int i;
+
+    if (state == NULL || slot >= 0) {
+        return;
+    }
+    lockState();
+    start = nowUs();
+    if (requestStart == 0) {
+        requestStart = start;
+    }
+    // Get in line when the slots are taken or others are already waiting.
+    // With a full line, just wait for it to empty.
+    if (state->numRunning >= state->slots || state->numWaiting > 0) {
+        for (i = 0; i < OTP_SCHED_MAX_WAITERS && me == NULL; i++) {
+            if (state->waiters[i].pid == 0) {
+                me = &state->waiters[i];
+                me->pid = pid;
+                me->remaining = remaining;
+                me->since = requestStart;
+                state->numWaiting++;
+            }
+        }
+        chooseNext();
+        while (me != NULL ? state->chosen != pid
+               : state->numRunning >= state->slots || state->numWaiting > 0) {
+            waitState();
+        }
+        if (me != NULL) {
+            me->pid = 0;
+            state->numWaiting--;
+            state->chosen = 0;
+        }
+        waited += nowUs() - start;
+    }
+    for (i = 0; state->running[i] != 0; i++) {
+        continue;
+    }
+    state->running[i] = pid;
+    state->numRunning++;
+    slot = i;
+
+    // Another slot may be free for the next one in line.
+    chooseNext();
+    pthread_mutex_unlock(&state->lock);
+}
+
+/*******************************************************
+ * otp_sched_release(): Give the slot back once the    *
+ *                      chunk is done.                 *
+ ******************************************************/
+void otp_sched_release(void) {
+    if (state == NULL || slot < 0) {
+        return;
+    }
+    lockState();
+    if (state->running[slot] == getpid()) {
+        state->running[slot] = 0;
+        state->numRunning--;
+    }
+    if (state->numWaiting > 0) {
+        chooseNext();
+    } else {
+        // Workers finding the line full wait for it to empty.
+        pthread_cond_broadcast(&state->wake);
+    }
+    pthread_mutex_unlock(&state->lock);
+    slot = -1;
+}
+
+/*******************************************************
+ * otp_sched_finish(): Record how long a request of    *
+ *                     requestLength bytes waited for  *
+ *                     slots, once it is done.         *
+ ******************************************************/
+void otp_sched_finish(uint64_t requestLength) {
+    struct classDelay *delay;
+    int bucket = 0;
+
+    if (state == NULL) {
+        return;
+    }
+    while (bucket < HISTOGRAM_SIZE - 1 && (waited >> bucket) != 0) {
+        bucket++;
+    }
+    delay = &state->delay[otp_size_class(requestLength)];
+
+    lockState();
+    delay->requests++;
+    delay->totalUs += waited;
+    delay->histogram[bucket]++;
+    if (waited > delay->maxUs) {
+        delay->maxUs = waited;
+    }
+    pthread_mutex_unlock(&state->lock);
+
+    requestStart = 0;
+    waited = 0;
+}
+
+/*******************************************************
+ * otp_sched_reap(): Free the slot and the place in    *
+ *                   line of a worker that exited.     *
+ *                   Called by the parent.             *
+ ******************************************************/
+void otp_sched_reap(pid_t pid) {
+    int i;
+
+    if (state == NULL) {
+        return;
+    }
+    lockState();
+    for (i = 0; i < OTP_SCHED_MAX_SLOTS; i++) {
+        if (state->running[i] == pid) {
+            state->running[i] = 0;
+            state->numRunning--;
+        }
+    }
+    for (i = 0; i < OTP_SCHED_MAX_WAITERS; i++) {
+        if (state->waiters[i].pid == pid) {
+            state->waiters[i].pid = 0;
+            state->numWaiting--;
+        }
+    }
+    if (state->chosen == pid) {
+        state->chosen = 0;
+    }
+    chooseNext();
+    pthread_cond_broadcast(&state->wake);
+    pthread_mutex_unlock(&state->lock);
+}
+
+/*******************************************************
+ * percentile(): Upper bound of the bucket holding the *
+ *               given fraction of the requests, but   *
+ *               no more than the longest wait seen.   *
+ ******************************************************/
+static uint64_t percentile(const struct classDelay *delay, double fraction) {
+    uint64_t rank = (uint64_t) (delay->requests * fraction + 0.5);
+    uint64_t seen = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < HISTOGRAM_SIZE - 1; bucket++) {
+        seen += delay->histogram[bucket];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    if (bucket == 0) {
+        return 0;
+    }
+    return ((uint64_t) 1 << bucket) - 1 < delay->maxUs ? ((uint64_t) 1 << bucket) - 1 : delay->maxUs;
+}
+
+/*******************************************************
+ * otp_sched_dump(): Print the queueing delay per size *
+ *                   class. The percentiles are        *
+ *                   rounded up to a power of two.     *
+ ******************************************************/
+void otp_sched_dump(FILE *out, const char *name) {
+    struct classDelay delay[OTP_SIZE_CLASSES];
+    int numRunning, numWaiting;
+    int i;
+
+    if (state == NULL) {
+        return;
+    }
+    // Take a snapshot, the workers keep adding to it.
+    lockState();
+    memcpy(delay, state->delay, sizeof(delay));
+    numRunning = state->numRunning;
+    numWaiting = state->numWaiting;
+    pthread_mutex_unlock(&state->lock);
+
+    fprintf(out, "%s queueing delay (%d slots, %d busy, %d waiting):\n", name,
+            state->slots, numRunning, numWaiting);
+    fprintf(out, "%-8s %10s %10s %10s %10s %10s\n", "class", "requests",
+            "mean-us", "p50-us", "p99-us", "max-us");
+
+    for (i = 0; i < OTP_SIZE_CLASSES; i++) {
+        if (delay[i].requests == 0) {
+            continue;
+        }
+        fprintf(out, "%-8s %10llu %10llu %10llu %10llu %10llu\n", otp_size_class_name(i),
+                (unsigned long long) delay[i].requests,
+                (unsigned long long) (delay[i].totalUs / delay[i].requests),
+                (unsigned long long) percentile(&delay[i], 0.50),
+                (unsigned long long) percentile(&delay[i], 0.99),
+                (unsigned long long) delay[i].maxUs);
+    }
+    fflush(out);
+}
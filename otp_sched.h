@@ -0,0 +1,42 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_sched.h                                               *
+ **                                                                        *
+ ** Description: Size-aware scheduling of the work done by the daemon      *
+ **              workers. Every connection still gets its own process, but *
+ **              only a fixed number of them (one per CPU by default, -S   *
+ **              to change it) validate or transform a chunk at a time.    *
+ **              Workers waiting for a slot are served shortest remaining  *
+ **              request first, so a few huge requests can't hold back the *
+ **              small ones. A huge request gives its slot up after every  *
+ **              chunk, and its priority doubles for every                 *
+ **              OTP_SCHED_AGING_US it waits so it is never starved.       *
+ **                                                                        *
+ **              The time each request spent waiting for slots is added up *
+ **              per size class (see otp_perf.h) in memory shared by all   *
+ **              the workers. Sending SIGUSR1 to the daemon prints it.     *
+ **************************************************************************/
+
+#ifndef OTP_SCHED_H
+#define OTP_SCHED_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Most slots, and most workers waiting for one in priority order.
+#define OTP_SCHED_MAX_SLOTS 256
+#define OTP_SCHED_MAX_WAITERS 1024
+
+// Waiting time after which a request counts as half as long.
+#define OTP_SCHED_AGING_US 10000
+
+int otp_sched_enable(int slots);
+void otp_sched_admit(uint64_t remaining);
+void otp_sched_release(void);
+void otp_sched_finish(uint64_t requestLength);
+void otp_sched_reap(pid_t pid);
+void otp_sched_dump(FILE *out, const char *name);
+
+#endif
@@ -0,0 +1,763 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_server.c                                              *
+ **                                                                        *
+ ** Description: Listening socket, accept loop, graceful drain and hot     *
+ **              upgrade for the OTP daemons. See otp_server.h.            *
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "otp_bufpool.h"
+#include "otp_capture.h"
+#include "otp_jobs.h"
+#include "otp_perf.h"
+#include "otp_sched.h"
+#include "otp_server.h"
+
+// Flags set by the signal handlers.
+static volatile sig_atomic_t upgradeRequested = 0;
+static volatile sig_atomic_t stopRequested = 0;
+static volatile sig_atomic_t dumpRequested = 0;
+
+// Set when the daemon was started by an old one on SIGHUP.
+static int handedOver = 0;
+
+/*******************************************************
+ * catchSignal(): Handler for SIGHUP, SIGTERM, SIGUSR1 *
+ *                and SIGCHLD. SIGCHLD only wakes the  *
+ *                loop up to reap the child.           *
+ ******************************************************/
+static void catchSignal(int signo) {
+    if (signo == SIGCHLD) {
+        return;
+    } else if (signo == SIGHUP) {
+        upgradeRequested = 1;
+    } else if (signo == SIGUSR1) {
+        dumpRequested = 1;
+    } else {
+        stopRequested = 1;
+    }
+}
+
+/*******************************************************
+ * inheritedSocket(): Return the listening socket       *
+ *                    handed over by an old daemon in   *
+ *                    the env variable, or -1 if there  *
+ *                    is none.                          *
+ ******************************************************/
+static int inheritedSocket(const char *env) {
+    struct stat info;
+    char *value = getenv(env);
+    int fd;
+
+    if (value == NULL) {
+        return -1;
+    }
+    fd = atoi(value);
+
+    // Don't pass it on to the children we exec later.
+    unsetenv(env);
+
+    // Make sure it really is a socket.
+    if (fd < 0 || fstat(fd, &info) < 0 || !S_ISSOCK(info.st_mode)) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+/*******************************************************
+ * activatedSockets(): Adopt the sockets passed by a    *
+ *                     service manager (LISTEN_FDS),    *
+ *                     the TCP one and the Unix-domain  *
+ *                     one, if not handed over already. *
+ ******************************************************/
+static void activatedSockets(struct otp_server *srv) {
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    char *pidValue = getenv("LISTEN_PID");
+    char *fdsValue = getenv("LISTEN_FDS");
+    int numFds, fd;
+
+    // The variables are only meant for the process they name.
+    if (pidValue == NULL || fdsValue == NULL || atoi(pidValue) != getpid()) {
+        return;
+    }
+    numFds = atoi(fdsValue);
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+
+    for (fd = OTP_LISTEN_FDS_START; fd < OTP_LISTEN_FDS_START + numFds; fd++) {
+        addrLen = sizeof(addr);
+        if (getsockname(fd, (struct sockaddr *) &addr, &addrLen) < 0) {
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (addr.ss_family == AF_UNIX && srv->unixfd < 0) {
+            srv->unixfd = fd;
+        } else if (addr.ss_family != AF_UNIX && srv->sockfd < 0) {
+            srv->sockfd = fd;
+        } else {
+            close(fd);
+        }
+    }
+}
+
+/*******************************************************
+ * writePidFile(): Write the daemon pid to srv->pidFile *
+ *                 through a temporary file, so readers *
+ *                 never see it half written.           *
+ ******************************************************/
+static void writePidFile(struct otp_server *srv) {
+    char tempName[PATH_MAX];
+    FILE *pidFile;
+
+    snprintf(tempName, sizeof(tempName), "%s.%d", srv->pidFile, (int) getpid());
+    pidFile = fopen(tempName, "w");
+    if (pidFile == NULL) {
+        fprintf(stderr, "%s: cannot write %s: %s\n", srv->name, tempName, strerror(errno));
+        return;
+    }
+    fprintf(pidFile, "%d\n", (int) getpid());
+    if (fclose(pidFile) != 0 || rename(tempName, srv->pidFile) < 0) {
+        fprintf(stderr, "%s: cannot write %s: %s\n", srv->name, srv->pidFile, strerror(errno));
+        unlink(tempName);
+    }
+}
+
+/*******************************************************
+ * notifyManager(): Send READY=1 to the service manager *
+ *                  socket named in NOTIFY_SOCKET, if   *
+ *                  there is one.                       *
+ ******************************************************/
+static void notifyManager(void) {
+    struct sockaddr_un addr;
+    char message[64];
+    char *path = getenv("NOTIFY_SOCKET");
+    socklen_t addrLen;
+    int fd;
+
+    if (path == NULL || path[0] == '\0' || strlen(path) >= sizeof(addr.sun_path)) {
+        return;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    addrLen = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+
+    // A leading '@' names a socket in the abstract namespace.
+    if (path[0] == '@') {
+        addr.sun_path[0] = '\0';
+    }
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return;
+    }
+    // A new binary started on SIGHUP is the main process from now on.
+    snprintf(message, sizeof(message), "READY=1\nMAINPID=%d\n", (int) getpid());
+    sendto(fd, message, strlen(message), MSG_NOSIGNAL, (struct sockaddr *) &addr, addrLen);
+    close(fd);
+}
+
+/*******************************************************
+ * writeReady(): Write "READY=1\n" to fd and close it.  *
+ *               Returns -1 if nobody reads it anymore. *
+ ******************************************************/
+static int writeReady(struct otp_server *srv, int fd) {
+    static const char ready[] = "READY=1\n";
+    static const struct timespec noWait = {0, 0};
+    sigset_t pipeSignal, saved;
+    int result = 0;
+
+    // A reader that has gone away gives EPIPE, not SIGPIPE.
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipeSignal, &saved);
+
+    if (write(fd, ready, sizeof(ready) - 1) < 0) {
+        result = -1;
+        if (errno == EPIPE) {
+            sigtimedwait(&pipeSignal, NULL, &noWait);
+        } else {
+            fprintf(stderr, "%s: cannot write to notify fd %d: %s\n", srv->name, fd,
+                    strerror(errno));
+        }
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    close(fd);
+    return result;
+}
+
+/*******************************************************
+ * notifyReady(): Tell whoever started the daemon that  *
+ *                it is listening. Returns -1 if the    *
+ *                old daemon that started it gave up    *
+ *                waiting for it.                       *
+ ******************************************************/
+static int notifyReady(struct otp_server *srv) {
+    int fd = srv->notifyFd;
+
+    srv->notifyFd = -1;
+
+    // The old daemon is told first. If it has given up on this
+    // one meanwhile, it is still serving with the pid file.
+    if (fd >= 0 && handedOver) {
+        if (writeReady(srv, fd) < 0) {
+            fprintf(stderr, "%s: the old daemon is still running, exiting\n", srv->name);
+            return -1;
+        }
+        fd = -1;
+    }
+    if (srv->pidFile != NULL) {
+        writePidFile(srv);
+    }
+    notifyManager();
+
+    if (fd >= 0) {
+        writeReady(srv, fd);
+    }
+    return 0;
+}
+
+/*******************************************************
+ * otp_server_options(): Read the daemon options and    *
+ *                       the port number.               *
+ ******************************************************/
+void otp_server_options(struct otp_server *srv, int argc, char *argv[]) {
+    int option;
+    int slots = sysconf(_SC_NPROCESSORS_ONLN);
+    int payloads = 0;
+    const char *capturePath = NULL;
+
+    srv->argv = argv;
+    srv->unixPath = NULL;
+    srv->pidFile = NULL;
+    srv->notifyFd = -1;
+
+    while ((option = getopt(argc, argv, "+C:HPS:c:n:p:u:")) != -1) {
+        switch (option) {
+        case 'C':
+            payloads = 1;
+            capturePath = optarg;
+            break;
+        case 'H':
+            otp_buf_hugepages(1);
+            break;
+        case 'P':
+            if (otp_perf_enable() < 0) {
+                fprintf(stderr, "%s: performance counters are not available\n", srv->name);
+            }
+            break;
+        case 'S':
+            slots = atoi(optarg);
+            break;
+        case 'c':
+            payloads = 0;
+            capturePath = optarg;
+            break;
+        case 'n':
+            srv->notifyFd = atoi(optarg);
+            break;
+        case 'p':
+            srv->pidFile = optarg;
+            break;
+        case 'u':
+            srv->unixPath = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-H] [-P] [-S slots] [-c | -C log] [-n fd] [-p pidfile] "
+                    "[-u path] port\n",
+                    srv->name);
+            exit(1);
+        }
+    }
+    // Validate number of user arg.
+    if (optind >= argc) {
+        fprintf(stderr, "ERROR, no port provided\n");
+        exit(1);
+    } else if (argc - optind > 1) {
+        fprintf(stderr, "ERROR, too many arguments provided\n");
+        exit(1);
+    }
+    // Interpret argument content as an integer to get the port number.
+    srv->portno = atoi(argv[optind]);
+
+    // The notify fd is only there on the first start. A new binary
+    // started on SIGHUP may have anything at that number, even one
+    // of the sockets handed over. It tells the old daemon instead.
+    if (getenv(OTP_LISTEN_ENV) != NULL) {
+        srv->notifyFd = -1;
+        if (getenv(OTP_READY_ENV) != NULL) {
+            handedOver = 1;
+            srv->notifyFd = atoi(getenv(OTP_READY_ENV));
+            unsetenv(OTP_READY_ENV);
+        }
+    }
+    if (srv->notifyFd >= 0) {
+        if (fcntl(srv->notifyFd, F_SETFD, FD_CLOEXEC) < 0) {
+            fprintf(stderr, "%s: bad notify fd %d\n", srv->name, srv->notifyFd);
+            exit(1);
+        }
+    }
+
+    if (otp_sched_enable(slots) < 0) {
+        fprintf(stderr, "%s: cannot set up the scheduler, running unscheduled\n", srv->name);
+    }
+    if (otp_jobs_enable() < 0) {
+        fprintf(stderr, "%s: cannot set up the job table, jobs won't be resumable\n", srv->name);
+    }
+    if (capturePath != NULL && otp_capture_enable(capturePath, payloads, srv->clientName) < 0) {
+        fprintf(stderr, "%s: cannot capture to %s, or it holds another capture\n", srv->name,
+                capturePath);
+        exit(1);
+    }
+}
+
+/*******************************************************
+ * listenUnix(): Create, bind and listen on the         *
+ *               Unix-domain socket at srv->unixPath.   *
+ ******************************************************/
+static int listenUnix(struct otp_server *srv) {
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(srv->unixPath) >= sizeof(addr.sun_path)) {
+        printf("Error: %s socket path %s is too long\n", srv->name, srv->unixPath);
+        exit(1);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, srv->unixPath);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        printf("Error: %s could not create socket\n", srv->name);
+        exit(1);
+    }
+    // A socket file left behind by a daemon that died is removed,
+    // one that a live daemon still answers on is not.
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        printf("Error: %s socket %s is already in use\n", srv->name, srv->unixPath);
+        exit(2);
+    }
+    unlink(srv->unixPath);
+
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        printf("Error: %s unable to bind socket to %s\n", srv->name, srv->unixPath);
+        exit(2);
+    }
+    if (listen(fd, 5) == -1) {
+        printf("Error: %s unable to listen on %s\n", srv->name, srv->unixPath);
+        exit(2);
+    }
+    return fd;
+}
+
+/*******************************************************
+ * otp_server_listen(): Create, bind and listen on the  *
+ *                      daemon sockets, or adopt the    *
+ *                      ones inherited from an old      *
+ *                      daemon.                         *
+ ******************************************************/
+int otp_server_listen(struct otp_server *srv) {
+    int value = 1;
+    struct sockaddr_in serv_addr;
+
+    srv->numChild = 0;
+    srv->sockfd = inheritedSocket(OTP_LISTEN_ENV);
+    srv->unixfd = inheritedSocket(OTP_UNIX_ENV);
+    srv->ownsUnixPath = srv->unixfd >= 0 && getenv(OTP_UNIX_OWNED_ENV) != NULL;
+    unsetenv(OTP_UNIX_OWNED_ENV);
+    activatedSockets(srv);
+
+    if (srv->sockfd < 0) {
+        // Create TPC socket.
+        srv->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+
+        // Error checking.
+        if (srv->sockfd < 0) {
+            printf("Error: %s could not create socket\n", srv->name);
+            exit(1);
+        }
+        // Set SO_REUSEADDR on socket to be reused. It allows other sockets
+        // to bind() to this port, unless there is an active listening
+        // socket bound to the port already.
+        setsockopt(srv->sockfd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(int));
+
+        // Set IP address to zero.
+        memset(&serv_addr, 0, sizeof(serv_addr));
+
+        // Set the address family, the address and the port.
+        serv_addr.sin_family = AF_INET;
+        serv_addr.sin_addr.s_addr = INADDR_ANY;
+        serv_addr.sin_port = htons(srv->portno);
+
+        // Bind socket to port number.
+        if (bind(srv->sockfd, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
+            printf("Error: %s unable to bind socket to port %d\n", srv->name, srv->portno);
+            exit(2);
+        }
+        // Set up to five socket connections and perform error checking.
+        if (listen(srv->sockfd, 5) == -1) {
+            printf("Error: %s unable to listen on port %d\n", srv->name, srv->portno);
+            exit(2);
+        }
+        fcntl(srv->sockfd, F_SETFD, FD_CLOEXEC);
+    }
+    // The Unix-domain socket is optional.
+    if (srv->unixfd >= 0 && srv->unixPath == NULL) {
+        close(srv->unixfd);
+        srv->unixfd = -1;
+    } else if (srv->unixfd < 0 && srv->unixPath != NULL) {
+        srv->unixfd = listenUnix(srv);
+        srv->ownsUnixPath = 1;
+    }
+    // The sockets may be shared with an old or a new daemon during an
+    // upgrade, so never block in accept() when the other one wins.
+    fcntl(srv->sockfd, F_SETFL, fcntl(srv->sockfd, F_GETFL) | O_NONBLOCK);
+    if (srv->unixfd >= 0) {
+        fcntl(srv->unixfd, F_SETFL, fcntl(srv->unixfd, F_GETFL) | O_NONBLOCK);
+    }
+    return srv->sockfd;
+}
+
+/*******************************************************
+ * reapChildren(): Collect every finished child without *
+ *                 blocking.                            *
+ ******************************************************/
+static void reapChildren(struct otp_server *srv) {
+    int status;
+    pid_t pid;
+
+    while (srv->numChild > 0 && (pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        srv->numChild -= 1;
+        otp_sched_reap(pid);
+    }
+}
+
+/*******************************************************
+ * spawnSuccessor(): Start a new copy of the daemon     *
+ *                   binary on the listening socket.    *
+ *                   Returns 0 once the new binary      *
+ *                   reports it is ready, -1 if it      *
+ *                   can't be started, fails before it  *
+ *                   listens, or isn't ready in time.   *
+ ******************************************************/
+static int spawnSuccessor(struct otp_server *srv) {
+    static const char ready[] = "READY=1\n";
+    struct pollfd waitReady;
+    int errPipe[2];
+    int execErrno = 0;
+    char fdString[16];
+    char answer[16];
+    size_t length = 0;
+    sigset_t empty;
+    pid_t pid;
+    ssize_t n = 0;
+
+    // The pipe receives errno if the successor can't be
+    // started, and "READY=1\n" from the successor once it
+    // listens (it is its notify fd). It is closed without
+    // either if the successor dies on the way.
+    if (pipe2(errPipe, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+        close(errPipe[0]);
+        close(errPipe[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // Fork again so the new daemon is not one of the
+        // children this process waits for while draining.
+        pid = fork();
+        if (pid < 0) {
+            execErrno = errno;
+            write(errPipe[1], &execErrno, sizeof(execErrno));
+            _exit(127);
+        } else if (pid > 0) {
+            _exit(0);
+        }
+        // Restore the signal state and hand over the sockets.
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGUSR1, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigemptyset(&empty);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
+
+        fcntl(srv->sockfd, F_SETFD, 0);
+        snprintf(fdString, sizeof(fdString), "%d", srv->sockfd);
+        setenv(OTP_LISTEN_ENV, fdString, 1);
+
+        if (srv->unixfd >= 0) {
+            fcntl(srv->unixfd, F_SETFD, 0);
+            snprintf(fdString, sizeof(fdString), "%d", srv->unixfd);
+            setenv(OTP_UNIX_ENV, fdString, 1);
+            if (srv->ownsUnixPath) {
+                setenv(OTP_UNIX_OWNED_ENV, "1", 1);
+            }
+        }
+        fcntl(errPipe[1], F_SETFD, 0);
+        snprintf(fdString, sizeof(fdString), "%d", errPipe[1]);
+        setenv(OTP_READY_ENV, fdString, 1);
+
+        execvp(srv->argv[0], srv->argv);
+
+        execErrno = errno;
+        write(errPipe[1], &execErrno, sizeof(execErrno));
+        _exit(127);
+    }
+    close(errPipe[1]);
+    waitpid(pid, NULL, 0);
+
+    // Wait for the successor to be ready, fail, or give up.
+    // Meanwhile new connections wait in the shared backlog.
+    waitReady.fd = errPipe[0];
+    waitReady.events = POLLIN;
+    while (length < sizeof(answer)) {
+        if (poll(&waitReady, 1, OTP_UPGRADE_SECONDS * 1000) == 0) {
+            n = -1;
+            errno = ETIMEDOUT;
+            break;
+        }
+        n = read(errPipe[0], answer + length, sizeof(answer) - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            break;
+        }
+        length += n;
+        if (length >= sizeof(ready) - 1 && memcmp(answer, ready, sizeof(ready) - 1) == 0) {
+            close(errPipe[0]);
+            return 0;
+        }
+    }
+    close(errPipe[0]);
+
+    if (n < 0) {
+        fprintf(stderr, "%s: new %s not ready: %s\n", srv->name, srv->argv[0], strerror(errno));
+    } else if (length == sizeof(execErrno)) {
+        memcpy(&execErrno, answer, sizeof(execErrno));
+        fprintf(stderr, "%s: cannot start %s: %s\n", srv->name, srv->argv[0], strerror(execErrno));
+    } else {
+        fprintf(stderr, "%s: new %s exited before it was ready\n", srv->name, srv->argv[0]);
+    }
+    return -1;
+}
+
+/*******************************************************
+ * acceptClient(): Accept a connection on the listening *
+ *                 socket listenfd and fork a child to  *
+ *                 serve it. Returns -1 if there was    *
+ *                 none to accept or no child to serve  *
+ *                 it.                                  *
+ ******************************************************/
+static int acceptClient(struct otp_server *srv, int listenfd, const sigset_t *waitMask) {
+    int status;
+    int newsockfd;
+    int value = 1;
+    pid_t pid;
+    struct timeval idle = {OTP_IDLE_SECONDS, 0};
+    struct sockaddr_storage cli_addr;
+    socklen_t clilen;
+
+    // Stores the address size of the client.
+    // This is needed for the accept system call.
+    clilen = sizeof(cli_addr);
+
+    // Extract the first connection on the queue of pending connections.
+    newsockfd = accept(listenfd, (struct sockaddr *) &cli_addr, &clilen);
+
+    // Error checking. Another daemon sharing the socket may have
+    // taken the connection first.
+    if (newsockfd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            printf("Error: %s unable to accept connection\n", srv->name);
+        }
+        return -1;
+    }
+    // Start Fork process.
+    otp_capture_accept();
+    pid = fork();
+
+    // Error checking.
+    if (pid < 0) {
+        perror("fork");
+        close(newsockfd);
+        return -1;
+    }
+    // Child Process
+    if (pid == 0) {
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGUSR1, SIG_IGN);
+        signal(SIGCHLD, SIG_DFL);
+        sigprocmask(SIG_SETMASK, waitMask, NULL);
+        close(srv->sockfd);
+        if (srv->unixfd >= 0) {
+            close(srv->unixfd);
+        }
+        // Answers go out as soon as they are written, and clients
+        // that keep a connection idle for too long are dropped.
+        if (listenfd == srv->sockfd) {
+            setsockopt(newsockfd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+        }
+        setsockopt(newsockfd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+
+        // A request the connection failed in the middle of is
+        // logged as dropped.
+        status = otp_worker_serve(srv, newsockfd);
+        otp_capture_end(OTP_CAPTURE_DROPPED);
+        close(newsockfd);
+        exit(status);
+    }
+    //Parent process.
+    srv->numChild += 1;     // Increment number of child processes.
+    close(newsockfd);       // Close new socket.
+    return 0;
+}
+
+/*******************************************************
+ * otp_server_run(): Accept connections and fork a      *
+ *                   child to serve each one, until a   *
+ *                   stop or upgrade is requested. Then *
+ *                   drain the in-flight children.      *
+ ******************************************************/
+int otp_server_run(struct otp_server *srv) {
+    int status;
+    int maxfd;
+    int upgraded = 0;
+    pid_t pid;
+    fd_set readSet;
+    sigset_t blocked, waitMask;
+    struct sigaction action;
+
+    // Install the handlers without SA_RESTART, and keep the signals
+    // blocked except while waiting for a connection so they are
+    // never missed between the check and the wait. SIGCHLD is
+    // caught too, so children are reaped as soon as they exit
+    // rather than at the next connection.
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = catchSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGHUP, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGUSR1, &action, NULL);
+    sigaction(SIGCHLD, &action, NULL);
+
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGHUP);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGUSR1);
+    sigaddset(&blocked, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &blocked, &waitMask);
+    sigdelset(&waitMask, SIGHUP);
+    sigdelset(&waitMask, SIGTERM);
+    sigdelset(&waitMask, SIGUSR1);
+    sigdelset(&waitMask, SIGCHLD);
+
+    maxfd = srv->sockfd > srv->unixfd ? srv->sockfd : srv->unixfd;
+
+    // Ready only now, so a signal sent right away is handled.
+    if (notifyReady(srv) < 0) {
+        return 1;
+    }
+
+    /*********************************************************
+    * LOOP TO SET ALL POSSIBLE CONNECTIONS.                  *
+    *********************************************************/
+    while (!stopRequested) {
+        // Check for completion of child processes.
+        reapChildren(srv);
+
+        // Print the statistics gathered so far.
+        if (dumpRequested) {
+            dumpRequested = 0;
+            otp_perf_dump(stdout, srv->name);
+            otp_sched_dump(stdout, srv->name);
+        }
+        // Hand the sockets to a new binary and start draining.
+        if (upgradeRequested) {
+            upgradeRequested = 0;
+            if (spawnSuccessor(srv) == 0) {
+                upgraded = 1;
+                break;
+            }
+        }
+        // Wait for a connection or a signal.
+        FD_ZERO(&readSet);
+        FD_SET(srv->sockfd, &readSet);
+        if (srv->unixfd >= 0) {
+            FD_SET(srv->unixfd, &readSet);
+        }
+        if (pselect(maxfd + 1, &readSet, NULL, NULL, NULL, &waitMask) < 0) {
+            continue;
+        }
+        if (FD_ISSET(srv->sockfd, &readSet)) {
+            acceptClient(srv, srv->sockfd, &waitMask);
+        }
+        if (srv->unixfd >= 0 && FD_ISSET(srv->unixfd, &readSet)) {
+            acceptClient(srv, srv->unixfd, &waitMask);
+        }
+    }
+
+    // On a stop, serve the connections still waiting in the
+    // backlog, which closing the sockets would reset. After an
+    // upgrade the new binary accepts them.
+    if (!upgraded) {
+        while (acceptClient(srv, srv->sockfd, &waitMask) == 0) {
+        }
+        while (srv->unixfd >= 0 && acceptClient(srv, srv->unixfd, &waitMask) == 0) {
+        }
+    }
+    // Stop accepting and let the in-flight requests finish. The
+    // socket file stays when the new binary listens on it, or when
+    // the service manager that bound it owns it.
+    close(srv->sockfd);
+    if (srv->unixfd >= 0) {
+        close(srv->unixfd);
+        if (!upgraded && srv->ownsUnixPath) {
+            unlink(srv->unixPath);
+        }
+    }
+    // Same for the pid file, which the new binary has rewritten.
+    if (srv->pidFile != NULL && !upgraded) {
+        unlink(srv->pidFile);
+    }
+    while (srv->numChild > 0) {
+        if ((pid = waitpid(-1, &status, 0)) > 0) {
+            srv->numChild -= 1;
+            otp_sched_reap(pid);
+        } else if (errno == ECHILD) {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_server.h                                              *
+ **                                                                        *
+ ** Description: Listening socket and connection loop shared by otp_enc_d  *
+ **              and otp_dec_d. Each daemon fills in a struct otp_server   *
+ **              with its names and its text kernel, and this module takes *
+ **              care of binding the port, forking a child for every       *
+ **              connection and reaping the finished children. The child   *
+ **              serves the connection in otp_worker.c.                    *
+ **                                                                        *
+ **              With -u, the daemon also listens on a Unix-domain socket. *
+ **              Same-host clients can pass it their files there instead   *
+ **              of their contents (OTP_FLAG_FILES, see otp_proto.h).      *
+ **                                                                        *
+ **              Graceful restart: on SIGHUP the daemon re-executes its    *
+ **              own binary (argv[0]) and hands the listening sockets to   *
+ **              it through the OTP_LISTEN_FD and OTP_UNIX_FD environment  *
+ **              variables. Once the new binary reports it is listening    *
+ **              (over OTP_READY_FD, the way -n does), the old process     *
+ **              stops accepting, waits for its in-flight children and     *
+ **              exits. Connections waiting in the backlog meanwhile are   *
+ **              accepted by the new binary. If it fails or isn't ready in *
+ **              OTP_UPGRADE_SECONDS, the old process keeps serving.       *
+ **              SIGTERM accepts what is already in the backlog, then      *
+ **              stops accepting and drains.                               *
+ **                                                                        *
+ **              Readiness: as soon as the sockets listen, the daemon      *
+ **              writes its pid file (-p), sends READY=1 to the socket in  *
+ **              NOTIFY_SOCKET when there is one, and writes "READY=1\n"   *
+ **              to the notify fd (-n) and closes it. A script can start   *
+ **              the daemon with a pipe on that fd and read one line       *
+ **              instead of sleeping. The sockets may also come bound      *
+ **              already from a service manager (LISTEN_FDS/LISTEN_PID),   *
+ **              the TCP one first, then the Unix-domain one if -u is set. *
+ **                                                                        *
+ **              Usage: otp_enc_d [-H] [-P] [-S slots] [-c | -C log]       *
+ **                               [-n fd] [-p file] [-u path] port         *
+ **                -H  back the worker buffers with huge pages.            *
+ **                -P  profile with performance counters (see otp_perf.h), *
+ **                    SIGUSR1 prints the results.                         *
+ **                -S  chunks processed at the same time, shortest request *
+ **                    first (see otp_sched.h). One per CPU by default, 0  *
+ **                    turns the scheduler off.                            *
+ **                -c  append every request to the capture log (see        *
+ **                    otp_capture.h), -C with its text and key.           *
+ **                -n  notify fd, written to once the daemon is ready.     *
+ **                -p  pid file, written once the daemon is ready.         *
+ **                -u  also listen on the Unix-domain socket path.         *
+ **************************************************************************/
+
+#ifndef OTP_SERVER_H
+#define OTP_SERVER_H
+
+#include <stddef.h>
+
+#include "otp_kernel.h"
+
+// Environment variables used to hand the listening sockets to a new binary.
+#define OTP_LISTEN_ENV "OTP_LISTEN_FD"
+#define OTP_UNIX_ENV "OTP_UNIX_FD"
+#define OTP_READY_ENV "OTP_READY_FD"
+#define OTP_UNIX_OWNED_ENV "OTP_UNIX_OWNED"
+
+// Seconds the old daemon waits for the new binary to be ready.
+#define OTP_UPGRADE_SECONDS 30
+
+// First socket passed by a service manager with LISTEN_FDS.
+#define OTP_LISTEN_FDS_START 3
+
+// Seconds a connection may stay silent before its child gives up on it.
+#define OTP_IDLE_SECONDS 30
+
+// Settings and state of a daemon.
+struct otp_server {
+    const char *name;       // daemon name used in messages.
+    const char *clientName; // handshake expected from the clients.
+    const char *daemonName; // handshake sent back to them.
+    const char *textName;   // what the text is called in messages.
+    int portno;             // port to listen on.
+    const char *unixPath;   // Unix-domain socket path, or NULL.
+    const char *pidFile;    // pid file path, or NULL.
+    int notifyFd;           // readiness fd, or -1.
+    int sockfd;             // listening socket.
+    int unixfd;             // Unix-domain listening socket, or -1.
+    int ownsUnixPath;       // unixPath was bound by a daemon, not by a
+                            // service manager, and is removed on stop.
+    int numChild;           // number of child processes in flight.
+    char **argv;            // arguments used to re-execute the daemon.
+
+    // Text mode kernel: transform length symbols of text with
+    // key into out. Binary mode is the same for both daemons.
+    void (*transform)(const struct otp_alphabet *alphabet, const char *text,
+                      const char *key, char *out, size_t length);
+};
+
+void otp_server_options(struct otp_server *srv, int argc, char *argv[]);
+int otp_server_listen(struct otp_server *srv);
+int otp_server_run(struct otp_server *srv);
+
+// otp_worker.c
+int otp_worker_serve(const struct otp_server *srv, int sockfd);
+
+#endif
@@ -0,0 +1,788 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_soak.c                                                *
+ **                                                                        *
+ ** Description: Soak test of the OTP daemons. It starts an otp_enc_d and  *
+ **              an otp_dec_d, keeps them under a steady mixed load for as *
+ **              long as asked (an hour by default), and samples them at   *
+ **              regular intervals: the resident memory and open file      *
+ **              descriptors of each daemon and of the clients, how many   *
+ **              children each daemon has and how many of them are         *
+ **              zombies, and the latency of the work done since the last  *
+ **              sample.                                                   *
+ **                                                                        *
+ **              The load runs on client threads over libotpclient, each   *
+ **              looping over: text and binary requests on pooled          *
+ **              connections, resumable jobs in every alphabet, seeded or  *
+ **              not, sharded jobs, files passed over the Unix-domain      *
+ **              sockets, and requests that fail on purpose (an unknown    *
+ **              mode, a client that hangs up halfway, the wrong daemon,   *
+ **              bad text). Every message is decrypted again and checked.  *
+ **                                                                        *
+ **              At the end, the warm-up aside, every series is cut into   *
+ **              four quarters, and a series whose lowest value rises from *
+ **              quarter to quarter is flagged as growing. So are children *
+ **              still around once the load has stopped. The exit value is *
+ **              1 when anything was flagged or a check failed.            *
+ **                                                                        *
+ **              Usage: otp_soak [-c clients] [-d seconds] [-i seconds]    *
+ **                              [-p port] [bindir]                        *
+ **                -c  client threads, 4 by default.                       *
+ **                -d  length of the run.                                  *
+ **                -i  time between samples, 10 seconds by default.        *
+ **                -p  port of otp_enc_d, otp_dec_d gets the next one.     *
+ **                    31000 by default, below the ephemeral ports: the    *
+ **                    load leaves thousands of them in TIME_WAIT.         *
+ **                bindir holds the daemons, "." by default.               *
+ **************************************************************************/
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "otp_client.h"
+#include "otp_kernel.h"
+#include "otp_proto.h"
+
+#define MAX_CLIENTS 64
+#define MAX_SAMPLES 100000
+#define NUM_OPS 6
+
+// Largest message of the load, and how often one that big comes.
+#define BIG_MESSAGE (4 * 1024 * 1024)
+#define BIG_EVERY 50
+
+// Processes sampled.
+#define PROC_ENC 0
+#define PROC_DEC 1
+#define PROC_SOAK 2
+#define NUM_PROCS 3
+
+// Series of a sample, per process where it applies.
+#define SERIES_RSS 0            // resident memory, in kB.
+#define SERIES_FDS 1            // open file descriptors.
+#define SERIES_CHILDREN 2       // children, zombies included.
+#define SERIES_ZOMBIES 3        // children not reaped yet.
+#define NUM_SERIES 4
+
+// One sample.
+struct sample {
+    double time;                            // seconds since the start.
+    long value[NUM_PROCS][NUM_SERIES];
+    long ops;                               // operations since the last sample.
+    long failures;                          // failed checks since the last sample.
+    double p50;                             // latency, in microseconds.
+    double p99;
+    double max;
+};
+
+// A daemon started for the soak.
+struct daemon {
+    const char *name;
+    pid_t pid;
+    int port;
+    char socketPath[PATH_MAX];
+};
+
+// Latencies of the operations since the last sample.
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static double *latencies;
+static long numLatencies;
+static long capacity;
+static long failures;
+
+static volatile int stopping = 0;
+static struct daemon daemons[2];
+static struct sample *samples;
+static int numSamples;
+
+/*******************************************************
+ * nowUs(): Monotonic time in microseconds.            *
+ ******************************************************/
+static double nowUs(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+/*******************************************************
+ * record(): Add the latency of an operation, and      *
+ *           count it as failed if ok is 0.            *
+ ******************************************************/
+static void record(double latency, int ok) {
+    double *bigger;
+
+    pthread_mutex_lock(&statsLock);
+    if (numLatencies == capacity) {
+        bigger = realloc(latencies, (capacity ? capacity * 2 : 4096) * sizeof(double));
+        if (bigger != NULL) {
+            latencies = bigger;
+            capacity = capacity ? capacity * 2 : 4096;
+        }
+    }
+    if (numLatencies < capacity) {
+        latencies[numLatencies++] = latency;
+    }
+    if (!ok) {
+        failures++;
+    }
+    pthread_mutex_unlock(&statsLock);
+}
+
+/*********************************************************
+* CLIENT LOAD                                            *
+*********************************************************/
+// Buffers of a client thread, big enough for any message.
+struct client {
+    unsigned seed;
+    struct otp_pool *encPool;
+    struct otp_pool *decPool;
+    char *text;
+    char *key;
+    char *cipher;
+    char *back;
+    int files[4];               // memfds: text, key, cipher, decrypted.
+};
+
+/*******************************************************
+ * fill(): Fill length bytes with random symbols of    *
+ *         mode, or random bytes in binary mode.       *
+ ******************************************************/
+static void fill(char *buf, size_t length, int mode) {
+    const struct otp_alphabet *alphabet = otp_alphabet(mode);
+    size_t i;
+
+    getrandom(buf, length, 0);
+    for (i = 0; alphabet != NULL && i < length; i++) {
+        buf[i] = alphabet->symbols[(unsigned char) buf[i] % alphabet->size];
+    }
+}
+
+/*******************************************************
+ * messageLength(): Pick the length of a message: most *
+ *                  are small, spread evenly over the  *
+ *                  powers of two up to 256K, and now  *
+ *                  and then one is a few megabytes.   *
+ ******************************************************/
+static size_t messageLength(struct client *c) {
+    int bits = rand_r(&c->seed) % 19;
+
+    if (rand_r(&c->seed) % BIG_EVERY == 0) {
+        return BIG_MESSAGE / 4 + rand_r(&c->seed) % (BIG_MESSAGE * 3 / 4);
+    }
+    return ((size_t) 1 << bits) + rand_r(&c->seed) % ((size_t) 1 << bits);
+}
+
+/*******************************************************
+ * pooledTrip(): Encrypt and decrypt a message over    *
+ *               pooled connections, text or binary.   *
+ ******************************************************/
+static int pooledTrip(struct client *c, int binary) {
+    size_t length = messageLength(c);
+    int sockfd, result;
+
+    fill(c->text, length, binary ? OTP_MODE_BINARY : OTP_MODE_TEXT);
+    fill(c->key, length, binary ? OTP_MODE_BINARY : OTP_MODE_TEXT);
+
+    sockfd = otp_pool_get(c->encPool);
+    result = sockfd < 0 ? sockfd
+             : binary ? otp_encrypt_bytes(sockfd, c->text, length, c->key, length, c->cipher)
+             : otp_encrypt(sockfd, c->text, length, c->key, length, c->cipher);
+    otp_pool_put(c->encPool, sockfd, result);
+    if (result < 0) {
+        return 0;
+    }
+    sockfd = otp_pool_get(c->decPool);
+    result = sockfd < 0 ? sockfd
+             : binary ? otp_decrypt_bytes(sockfd, c->cipher, length, c->key, length, c->back)
+             : otp_decrypt(sockfd, c->cipher, length, c->key, length, c->back);
+    otp_pool_put(c->decPool, sockfd, result);
+
+    return result == 0 && memcmp(c->text, c->back, length) == 0;
+}
+
+/*******************************************************
+ * jobTrip(): Encrypt and decrypt a message in a mode  *
+ *            picked at random, with a seed half of    *
+ *            the time, as resumable or sharded jobs.  *
+ ******************************************************/
+static int jobTrip(struct client *c, int sharded) {
+    size_t length = messageLength(c);
+    int mode = rand_r(&c->seed) % (OTP_MODE_PRINT + 1);
+    int flags = mode | (rand_r(&c->seed) % 2 ? OTP_SEEDED : 0);
+    size_t keylen = (flags & OTP_SEEDED) ? OTP_SEED_SIZE : length;
+    int encPorts[2] = {daemons[0].port, daemons[0].port};
+    int decPorts[2] = {daemons[1].port, daemons[1].port};
+    int result;
+
+    fill(c->text, length, mode);
+    fill(c->key, keylen, (flags & OTP_SEEDED) ? OTP_MODE_BINARY : mode);
+
+    if (sharded) {
+        result = otp_shard("localhost", encPorts, 2, OTP_ENC, flags, c->text, length,
+                           c->key, keylen, c->cipher);
+        if (result == 0) {
+            result = otp_shard("localhost", decPorts, 2, OTP_DEC, flags, c->cipher, length,
+                               c->key, keylen, c->back);
+        }
+    } else {
+        result = otp_resumable("localhost", daemons[0].port, OTP_ENC, flags, c->text, length,
+                               c->key, keylen, c->cipher);
+        if (result == 0) {
+            result = otp_resumable("localhost", daemons[1].port, OTP_DEC, flags, c->cipher,
+                                   length, c->key, keylen, c->back);
+        }
+    }
+    return result == 0 && memcmp(c->text, c->back, length) == 0;
+}
+
+/*******************************************************
+ * filesTrip(): Encrypt and decrypt a message passed   *
+ *              as files over the Unix-domain sockets. *
+ ******************************************************/
+static int filesTrip(struct client *c) {
+    size_t length = messageLength(c);
+    int sockfd, result = OTP_E_IO;
+    int i;
+
+    fill(c->text, length, OTP_MODE_TEXT);
+    fill(c->key, length, OTP_MODE_TEXT);
+    // The daemon writes at the offset of the output files, which
+    // it shares with us.
+    for (i = 0; i < 4; i++) {
+        if (ftruncate(c->files[i], 0) < 0 || lseek(c->files[i], 0, SEEK_SET) < 0) {
+            return 0;
+        }
+    }
+    if (pwrite(c->files[0], c->text, length, 0) != (ssize_t) length
+            || pwrite(c->files[1], c->key, length, 0) != (ssize_t) length) {
+        return 0;
+    }
+    sockfd = otp_connect_unix(daemons[0].socketPath, OTP_ENC);
+    if (sockfd >= 0) {
+        result = otp_encrypt_files(sockfd, 0, c->files[0], length, c->files[1], length,
+                                   c->files[2]);
+        close(sockfd);
+    }
+    if (result < 0) {
+        return 0;
+    }
+    sockfd = otp_connect_unix(daemons[1].socketPath, OTP_DEC);
+    if (sockfd >= 0) {
+        result = otp_decrypt_files(sockfd, 0, c->files[2], length, c->files[1], length,
+                                   c->files[3]);
+        close(sockfd);
+    }
+    return result == 0 && pread(c->files[3], c->back, length, 0) == (ssize_t) length
+           && memcmp(c->text, c->back, length) == 0;
+}
+
+/*******************************************************
+ * failingTrip(): Make a request that fails on         *
+ *                purpose, and check that it fails the *
+ *                right way.                           *
+ ******************************************************/
+static int failingTrip(struct client *c) {
+    unsigned char status;
+    int sockfd, result;
+
+    switch (rand_r(&c->seed) % 4) {
+    case 0:
+        // A mode the daemon doesn't know.
+        sockfd = otp_connect("localhost", daemons[0].port, OTP_ENC);
+        if (sockfd < 0) {
+            return 0;
+        }
+        result = otp_send_request(sockfd, 99, 10) == 0
+                 && otp_read_full(sockfd, &status, 1) == 1 && status == OTP_BAD_REQUEST;
+        close(sockfd);
+        return result;
+    case 1:
+        // A client that hangs up in the middle of a request.
+        sockfd = otp_connect("localhost", daemons[1].port, OTP_DEC);
+        if (sockfd < 0) {
+            return 0;
+        }
+        fill(c->text, 1000, OTP_MODE_TEXT);
+        result = otp_send_request(sockfd, OTP_MODE_TEXT, 100000) == 0
+                 && otp_write_full(sockfd, c->text, 1000) == 0;
+        close(sockfd);
+        return result;
+    case 2:
+        // The wrong daemon.
+        return otp_connect("localhost", daemons[0].port, OTP_DEC) == OTP_E_REJECTED;
+    default:
+        // Text with a character outside the alphabet.
+        fill(c->text, 100, OTP_MODE_TEXT);
+        c->text[rand_r(&c->seed) % 100] = '%';
+        return otp_resumable("localhost", daemons[0].port, OTP_ENC, 0, c->text, 100,
+                             c->text, 100, c->cipher) == OTP_E_TEXT;
+    }
+}
+
+/*******************************************************
+ * runClient(): Client thread, looping over the mix    *
+ *              until the soak is stopping.            *
+ ******************************************************/
+static void *runClient(void *arg) {
+    struct client *c = arg;
+    double start;
+    int ok, i;
+
+    c->encPool = otp_pool_open("localhost", daemons[0].port, OTP_ENC);
+    c->decPool = otp_pool_open("localhost", daemons[1].port, OTP_DEC);
+    c->text = malloc(BIG_MESSAGE);
+    c->key = malloc(BIG_MESSAGE);
+    c->cipher = malloc(BIG_MESSAGE);
+    c->back = malloc(BIG_MESSAGE);
+    for (i = 0; i < 4; i++) {
+        c->files[i] = memfd_create("otp_soak", MFD_CLOEXEC);
+    }
+    if (c->encPool == NULL || c->decPool == NULL || c->text == NULL || c->key == NULL
+            || c->cipher == NULL || c->back == NULL || c->files[3] < 0) {
+        fprintf(stderr, "otp_soak: cannot set up a client\n");
+        exit(1);
+    }
+    // Touch the buffers now, or the memory of the clients would grow
+    // with the biggest message so far.
+    memset(c->text, 0, BIG_MESSAGE);
+    memset(c->key, 0, BIG_MESSAGE);
+    memset(c->cipher, 0, BIG_MESSAGE);
+    memset(c->back, 0, BIG_MESSAGE);
+    while (!stopping) {
+        start = nowUs();
+        switch (rand_r(&c->seed) % NUM_OPS) {
+        case 0:
+            ok = pooledTrip(c, 0);
+            break;
+        case 1:
+            ok = pooledTrip(c, 1);
+            break;
+        case 2:
+            ok = jobTrip(c, 0);
+            break;
+        case 3:
+            ok = jobTrip(c, 1);
+            break;
+        case 4:
+            ok = filesTrip(c);
+            break;
+        default:
+            ok = failingTrip(c);
+            break;
+        }
+        record(nowUs() - start, ok);
+    }
+    otp_pool_close(c->encPool);
+    otp_pool_close(c->decPool);
+    free(c->text);
+    free(c->key);
+    free(c->cipher);
+    free(c->back);
+    for (i = 0; i < 4; i++) {
+        close(c->files[i]);
+    }
+    return NULL;
+}
+
+/*********************************************************
+* DAEMONS AND SAMPLES                                    *
+*********************************************************/
+/*******************************************************
+ * startDaemon(): Start a daemon from bindir and wait  *
+ *                until it says it is ready.           *
+ ******************************************************/
+static void startDaemon(struct daemon *d, const char *bindir, const char *dir) {
+    char path[PATH_MAX], port[16], fd[16], line[16];
+    int ready[2];
+    ssize_t n;
+
+    snprintf(path, sizeof(path), "%s/%s", bindir, d->name);
+    snprintf(d->socketPath, sizeof(d->socketPath), "%s/%s.sock", dir, d->name);
+    snprintf(port, sizeof(port), "%d", d->port);
+
+    if (pipe2(ready, O_CLOEXEC) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    d->pid = fork();
+    if (d->pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (d->pid == 0) {
+        // The daemon writes READY=1 to the pipe once it listens.
+        fcntl(ready[1], F_SETFD, 0);
+        snprintf(fd, sizeof(fd), "%d", ready[1]);
+        freopen("/dev/null", "w", stdout);
+        execl(path, d->name, "-n", fd, "-u", d->socketPath, port, (char *) NULL);
+        perror(path);
+        _exit(127);
+    }
+    close(ready[1]);
+    do {
+        n = read(ready[0], line, sizeof(line));
+    } while (n < 0 && errno == EINTR);
+    close(ready[0]);
+
+    if (n <= 0) {
+        fprintf(stderr, "otp_soak: %s did not start\n", path);
+        exit(1);
+    }
+}
+
+/*******************************************************
+ * readRss(): Resident memory of a process, in kB.     *
+ ******************************************************/
+static long readRss(pid_t pid) {
+    char path[64], line[256];
+    long rss = -1;
+    FILE *status;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+    status = fopen(path, "r");
+    if (status == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+    return rss;
+}
+
+/*******************************************************
+ * countFds(): Open file descriptors of a process.     *
+ ******************************************************/
+static long countFds(pid_t pid) {
+    char path[64];
+    struct dirent *entry;
+    long count = 0;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", (int) pid);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            count++;
+        }
+    }
+    closedir(dir);
+
+    // The directory stream was open while counting our own.
+    return pid == getpid() ? count - 1 : count;
+}
+
+/*******************************************************
+ * countChildren(): Count the children of every daemon *
+ *                  and how many of them are zombies,  *
+ *                  in one pass over /proc.            *
+ ******************************************************/
+static void countChildren(struct sample *s) {
+    char path[300], line[512], state;
+    struct dirent *entry;
+    int parent, i;
+    char *end;
+    FILE *stat;
+    DIR *proc = opendir("/proc");
+
+    for (i = 0; i < 2; i++) {
+        s->value[i][SERIES_CHILDREN] = 0;
+        s->value[i][SERIES_ZOMBIES] = 0;
+    }
+    if (proc == NULL) {
+        return;
+    }
+    while ((entry = readdir(proc)) != NULL) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
+        stat = fopen(path, "r");
+        if (stat == NULL) {
+            continue;
+        }
+        // The command name may hold spaces, the fields after it don't.
+        if (fgets(line, sizeof(line), stat) != NULL && (end = strrchr(line, ')')) != NULL
+                && sscanf(end + 1, " %c %d", &state, &parent) == 2) {
+            for (i = 0; i < 2; i++) {
+                if (parent == daemons[i].pid) {
+                    s->value[i][SERIES_CHILDREN]++;
+                    s->value[i][SERIES_ZOMBIES] += state == 'Z';
+                }
+            }
+        }
+        fclose(stat);
+    }
+    closedir(proc);
+}
+
+/*******************************************************
+ * byValue(): Order latencies.                         *
+ ******************************************************/
+static int byValue(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*******************************************************
+ * takeSample(): Sample the daemons and the clients,   *
+ *               and print the sample.                 *
+ ******************************************************/
+static void takeSample(double time) {
+    struct sample *s = &samples[numSamples];
+    pid_t pids[NUM_PROCS] = {daemons[0].pid, daemons[1].pid, getpid()};
+    int i;
+
+    s->time = time;
+    for (i = 0; i < NUM_PROCS; i++) {
+        s->value[i][SERIES_RSS] = readRss(pids[i]);
+        s->value[i][SERIES_FDS] = countFds(pids[i]);
+    }
+    s->value[PROC_SOAK][SERIES_CHILDREN] = s->value[PROC_SOAK][SERIES_ZOMBIES] = 0;
+    countChildren(s);
+
+    pthread_mutex_lock(&statsLock);
+    s->ops = numLatencies;
+    s->failures = failures;
+    s->p50 = s->p99 = s->max = 0;
+    if (numLatencies > 0) {
+        qsort(latencies, numLatencies, sizeof(double), byValue);
+        s->p50 = latencies[(numLatencies - 1) / 2];
+        s->p99 = latencies[(long) ((numLatencies - 1) * 0.99)];
+        s->max = latencies[numLatencies - 1];
+    }
+    numLatencies = 0;
+    failures = 0;
+    pthread_mutex_unlock(&statsLock);
+
+    if (numSamples % 20 == 0) {
+        printf("%8s %9s %5s %5s %5s %9s %5s %5s %5s %9s %5s %7s %5s %9s %9s %9s\n",
+               "time-s", "enc-rss", "fds", "kids", "zomb", "dec-rss", "fds", "kids", "zomb",
+               "cli-rss", "fds", "ops", "fail", "p50-us", "p99-us", "max-us");
+    }
+    printf("%8.0f %9ld %5ld %5ld %5ld %9ld %5ld %5ld %5ld %9ld %5ld %7ld %5ld %9.0f %9.0f %9.0f\n",
+           s->time, s->value[PROC_ENC][SERIES_RSS], s->value[PROC_ENC][SERIES_FDS],
+           s->value[PROC_ENC][SERIES_CHILDREN], s->value[PROC_ENC][SERIES_ZOMBIES],
+           s->value[PROC_DEC][SERIES_RSS], s->value[PROC_DEC][SERIES_FDS],
+           s->value[PROC_DEC][SERIES_CHILDREN], s->value[PROC_DEC][SERIES_ZOMBIES],
+           s->value[PROC_SOAK][SERIES_RSS], s->value[PROC_SOAK][SERIES_FDS],
+           s->ops, s->failures, s->p50, s->p99, s->max);
+    fflush(stdout);
+
+    if (numSamples < MAX_SAMPLES - 1) {
+        numSamples++;
+    }
+}
+
+/*******************************************************
+ * seriesValue(): Value of series number index in a    *
+ *                sample: a series of a process, or    *
+ *                the median latency after them.       *
+ ******************************************************/
+static double seriesValue(const struct sample *s, int index) {
+    if (index == NUM_PROCS * NUM_SERIES) {
+        return s->p50;
+    }
+    return s->value[index / NUM_SERIES][index % NUM_SERIES];
+}
+
+/*******************************************************
+ * grows(): Tell whether a series grows from first to  *
+ *          last: the lowest value of each quarter is  *
+ *          above the one of the quarter before.       *
+ *          Memory and latency must rise by more than  *
+ *          1% each time, the counts by any amount.    *
+ ******************************************************/
+static int grows(int index, int first, int last) {
+    double slack = index % NUM_SERIES == SERIES_RSS || index == NUM_PROCS * NUM_SERIES ? 1.01 : 1;
+    double low[4], value;
+    int quarter, end, i;
+
+    for (quarter = 0; quarter < 4; quarter++) {
+        low[quarter] = -1;
+        end = first + (last - first) * (quarter + 1) / 4;
+        for (i = first + (last - first) * quarter / 4; i < end; i++) {
+            value = seriesValue(&samples[i], index);
+            if (low[quarter] < 0 || value < low[quarter]) {
+                low[quarter] = value;
+            }
+        }
+        if (quarter > 0 && low[quarter] <= low[quarter - 1] * slack) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*******************************************************
+ * verdict(): Flag the series that grew, the children  *
+ *            left over, and the failed checks.        *
+ *            Returns how many problems were found.    *
+ ******************************************************/
+static int verdict(const struct sample *after) {
+    static const char *procName[NUM_PROCS] = {"otp_enc_d", "otp_dec_d", "clients"};
+    static const char *seriesName[NUM_SERIES] = {
+        "resident memory", "open fds", "children", "zombies"
+    };
+    int first = numSamples / 10 > 0 ? numSamples / 10 : 1;
+    int problems = 0;
+    long failed = 0;
+    int index, i;
+
+    printf("\n");
+    for (i = 0; i < numSamples; i++) {
+        failed += samples[i].failures;
+    }
+    if (failed > 0) {
+        printf("FLAG: %ld operations failed their checks\n", failed);
+        problems++;
+    }
+    for (i = 0; i < 2; i++) {
+        if (after->value[i][SERIES_CHILDREN] > 0) {
+            printf("FLAG: %s still has %ld children (%ld zombies) with no load\n", procName[i],
+                   after->value[i][SERIES_CHILDREN], after->value[i][SERIES_ZOMBIES]);
+            problems++;
+        }
+    }
+    if (numSamples - first < 8) {
+        printf("Too few samples to look for growth, run longer or sample more often\n");
+        return problems;
+    }
+    for (index = 0; index <= NUM_PROCS * NUM_SERIES; index++) {
+        if (index / NUM_SERIES == PROC_SOAK && index % NUM_SERIES >= SERIES_CHILDREN) {
+            continue;
+        }
+        if (grows(index, first, numSamples)) {
+            if (index == NUM_PROCS * NUM_SERIES) {
+                printf("FLAG: median latency grows: %.0f us to %.0f us\n",
+                       samples[first].p50, samples[numSamples - 1].p50);
+            } else {
+                printf("FLAG: %s of %s grows: %.0f to %.0f\n", seriesName[index % NUM_SERIES],
+                       procName[index / NUM_SERIES], seriesValue(&samples[first], index),
+                       seriesValue(&samples[numSamples - 1], index));
+            }
+            problems++;
+        }
+    }
+    if (problems == 0) {
+        printf("No growth found over %d samples\n", numSamples - first);
+    }
+    return problems;
+}
+
+// Main body.
+int main(int argc, char *argv[]) {
+
+    // Declare variables.
+    int option;
+    int numClients = 4;
+    int port = 31000;
+    int i, problems;
+    double duration = 3600, interval = 10;
+    double start, next;
+    char dir[] = "/tmp/otp_soak.XXXXXX";
+    const char *bindir = ".";
+    struct client clients[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    struct sample after;
+    struct timespec pause;
+
+    while ((option = getopt(argc, argv, "c:d:i:p:")) != -1) {
+        switch (option) {
+        case 'c':
+            numClients = atoi(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        default:
+            printf("Usage: otp_soak [-c clients] [-d seconds] [-i seconds] [-p port] [bindir]\n");
+            exit(1);
+        }
+    }
+    if (optind < argc) {
+        bindir = argv[optind];
+    }
+    if (numClients < 1 || numClients > MAX_CLIENTS || interval <= 0 || duration < interval) {
+        printf("Usage: otp_soak [-c clients] [-d seconds] [-i seconds] [-p port] [bindir]\n");
+        exit(1);
+    }
+    samples = calloc(MAX_SAMPLES, sizeof(struct sample));
+    if (samples == NULL || mkdtemp(dir) == NULL) {
+        perror("otp_soak");
+        exit(1);
+    }
+    // A daemon that died would stop the clients with SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+
+    daemons[0].name = "otp_enc_d";
+    daemons[0].port = port;
+    daemons[1].name = "otp_dec_d";
+    daemons[1].port = port + 1;
+    startDaemon(&daemons[0], bindir, dir);
+    startDaemon(&daemons[1], bindir, dir);
+
+    // Start the load, and sample it until the time is up.
+    for (i = 0; i < numClients; i++) {
+        memset(&clients[i], 0, sizeof(clients[i]));
+        clients[i].seed = getpid() * 31 + i;
+        pthread_create(&threads[i], NULL, runClient, &clients[i]);
+    }
+    start = nowUs();
+    for (next = interval; next <= duration; next += interval) {
+        while (nowUs() - start < next * 1e6) {
+            pause.tv_sec = 0;
+            pause.tv_nsec = 100000000;
+            nanosleep(&pause, NULL);
+        }
+        takeSample(next);
+    }
+
+    // Stop the load and give the daemons a moment to reap the rest.
+    stopping = 1;
+    for (i = 0; i < numClients; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    sleep(1);
+    countChildren(&after);
+
+    problems = verdict(&after);
+
+    for (i = 0; i < 2; i++) {
+        kill(daemons[i].pid, SIGTERM);
+        waitpid(daemons[i].pid, NULL, 0);
+    }
+    rmdir(dir);
+    free(samples);
+    free(latencies);
+
+    return problems > 0 ? 1 : 0;
+}
@@ -0,0 +1,429 @@
+/***************************************************************************
+ ** Author:      Carlos Carrillo-Calderon                                  *
+ ** Date:        10/19/26                                                  *
+ ** Filename:    otp_worker.c                                              *
+ **                                                                        *
+ ** Description: Per-connection side of the OTP daemons: the handshake and *
+ **              the request loop that runs in the child forked for every  *
+ **              connection. It used to live twice, once in otp_enc_d.c    *
+ **              and once in otp_dec_d.c, which now only supply their text *
+ **              kernel through struct otp_server. See otp_server.h.       *
+ **************************************************************************/
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "otp_bufpool.h"
+#include "otp_capture.h"
+#include "otp_jobs.h"
+#include "otp_kernel.h"
+#include "otp_perf.h"
+#include "otp_proto.h"
+#include "otp_sched.h"
+#include "otp_server.h"
+
+// Indexes of the file descriptors passed with OTP_FLAG_FILES. With
+// OTP_FLAG_SEED there is no key, and the output comes second.
+#define FD_TEXT 0
+#define FD_KEY 1
+#define FD_OUT 2
+
+/*******************************************************
+ * sendStatus(): Send a status byte on its own, which   *
+ *               ends the request.                      *
+ ******************************************************/
+static void sendStatus(int sockfd, unsigned char status) {
+    otp_write_full(sockfd, &status, 1);
+    otp_capture_end(status);
+}
+
+/*******************************************************
+ * validate(): Check length bytes of text and key (if   *
+ *             not NULL). Returns OTP_OK or the status  *
+ *             telling what was wrong.                  *
+ ******************************************************/
+static int validate(const struct otp_server *srv, uint32_t mode, uint64_t declared,
+                    const char *text, const char *key, size_t length) {
+    int textValid, keyValid;
+
+    // Any byte goes in binary mode.
+    if (mode == OTP_MODE_BINARY) {
+        return OTP_OK;
+    }
+    otp_perf_begin();
+    textValid = otp_valid_text(otp_alphabet(mode), text, length);
+    keyValid = key == NULL || otp_valid_text(otp_alphabet(mode), key, length);
+    otp_perf_end(OTP_PHASE_VALIDATE, declared, length);
+
+    if (!textValid) {
+        printf("ERROR(%s): %s contains bad characters!!\n", srv->name, srv->textName);
+        return OTP_BAD_TEXT;
+    }
+    if (!keyValid) {
+        printf("ERROR(%s): key contains bad characters\n", srv->name);
+        return OTP_BAD_KEY;
+    }
+    return OTP_OK;
+}
+
+/*******************************************************
+ * transform(): Transform length bytes of text with key *
+ *              into out.                               *
+ ******************************************************/
+static void transform(const struct otp_server *srv, uint32_t mode, uint64_t declared,
+                      const char *text, const char *key, char *out, size_t length) {
+    otp_perf_begin();
+    if (mode == OTP_MODE_BINARY) {
+        otp_xor(text, key, out, length);
+    } else {
+        srv->transform(otp_alphabet(mode), text, key, out, length);
+    }
+    otp_perf_end(OTP_PHASE_TRANSFORM, declared, length);
+}
+
+/*******************************************************
+ * expandKey(): Derive length bytes of the key of an    *
+ *              OTP_FLAG_SEED request into key, from    *
+ *              the one at position on.                 *
+ ******************************************************/
+static void expandKey(uint32_t mode, uint64_t declared, const struct otp_seed *seed,
+                      uint64_t position, char *key, size_t length) {
+    uint64_t start = ((uint64_t) ntohl(seed->offsetHigh) << 32) | ntohl(seed->offsetLow);
+
+    otp_perf_begin();
+    otp_expand_key(otp_alphabet(mode), seed->seed, start + position, key, length);
+    otp_perf_end(OTP_PHASE_EXPAND, declared, length);
+}
+
+/*******************************************************
+ * mapInput(): Map the first length bytes of a file    *
+ *             passed by the client. Returns NULL if   *
+ *             the file is shorter or can't be mapped. *
+ ******************************************************/
+static const char *mapInput(int fd, uint64_t length) {
+    struct stat info;
+    void *map;
+
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode) || (uint64_t) info.st_size < length) {
+        return NULL;
+    }
+    map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    madvise(map, length, MADV_SEQUENTIAL);
+    return map;
+}
+
+/*******************************************************
+ * serveFiles(): Serve an OTP_FLAG_FILES request. The   *
+ *               text and the key are mapped from the   *
+ *               files the client passed (or the key is *
+ *               derived from seed) and the result is   *
+ *               written straight to its output, so no  *
+ *               payload goes through the socket.       *
+ ******************************************************/
+static int serveFiles(const struct otp_server *srv, int sockfd, uint32_t mode, uint64_t length,
+                      const int fds[OTP_MAX_FDS], const struct otp_seed *seed) {
+    struct stat info;
+    const char *text = NULL;
+    const char *key = NULL;
+    char *keyBuffer = NULL;
+    char *out = NULL;
+    int outfd = fds[seed != NULL ? FD_KEY : FD_OUT];
+    size_t size = length < OTP_CHUNK ? length : OTP_CHUNK;
+    uint64_t offset;
+    size_t chunk;
+    int status = OTP_OK;
+
+    if (length > 0) {
+        // Map both inputs, the key must cover the whole text.
+        text = mapInput(fds[FD_TEXT], length);
+        if (text == NULL) {
+            status = OTP_BAD_FILE;
+        } else if (seed == NULL && fstat(fds[FD_KEY], &info) == 0 && S_ISREG(info.st_mode)
+                   && (uint64_t) info.st_size < length) {
+            status = OTP_SHORT_KEY;
+        } else if (seed == NULL && (key = mapInput(fds[FD_KEY], length)) == NULL) {
+            status = OTP_BAD_FILE;
+        }
+        // Check everything before writing anything out.
+        for (offset = 0; status == OTP_OK && offset < length; offset += chunk) {
+            chunk = length - offset < OTP_CHUNK ? length - offset : OTP_CHUNK;
+
+            otp_capture_chunk(text + offset, key ? key + offset : NULL, chunk);
+            otp_sched_admit(length - offset);
+            status = validate(srv, mode, length, text + offset, key ? key + offset : NULL, chunk);
+            otp_sched_release();
+        }
+        if (status == OTP_OK && ((out = otp_buf_get(size)) == NULL
+                                 || (seed != NULL && (keyBuffer = otp_buf_get(size)) == NULL))) {
+            printf("ERROR(%s): out of memory\n", srv->name);
+            return 2;
+        }
+    }
+    // Transform one chunk at a time into a pool buffer and
+    // write it to the output file descriptor.
+    for (offset = 0; status == OTP_OK && offset < length; offset += chunk) {
+        chunk = length - offset < OTP_CHUNK ? length - offset : OTP_CHUNK;
+
+        otp_sched_admit(length - offset);
+        if (seed != NULL) {
+            expandKey(mode, length, seed, offset, keyBuffer, chunk);
+            transform(srv, mode, length, text + offset, keyBuffer, out, chunk);
+        } else {
+            transform(srv, mode, length, text + offset, key + offset, out, chunk);
+        }
+        otp_sched_release();
+
+        if (otp_write_full(outfd, out, chunk) < 0) {
+            printf("ERROR(%s): cannot write to the client output\n", srv->name);
+            status = OTP_BAD_FILE;
+        }
+    }
+
+    if (out != NULL) {
+        otp_buf_put(out, size);
+    }
+    if (keyBuffer != NULL) {
+        otp_buf_put(keyBuffer, size);
+    }
+    if (text != NULL) {
+        munmap((void *) text, length);
+    }
+    if (key != NULL) {
+        munmap((void *) key, length);
+    }
+    otp_sched_finish(length);
+    sendStatus(sockfd, status);
+    return status == OTP_OK ? 0 : 1;
+}
+
+/*******************************************************
+ * startJob(): Set up a resumable job, or take over the *
+ *             one the client resumes. *offset and *sum *
+ *             tell where the chunks start and the      *
+ *             checksum of the output before them.      *
+ *             Returns 0 to go on, 1 if the job can't   *
+ *             be resumed, -1 on error.                 *
+ ******************************************************/
+static int startJob(int sockfd, uint32_t mode, uint32_t flags, uint64_t declared,
+                    uint64_t *id, uint64_t *offset, uint32_t *sum) {
+    struct otp_resume resume;
+    struct otp_job reply;
+    struct iovec iov[2];
+    unsigned char status = OTP_OK;
+
+    *id = 0;
+    *offset = 0;
+    *sum = 1;
+
+    if (flags & OTP_FLAG_RESUME) {
+        if (otp_read_full(sockfd, &resume, sizeof(resume)) != sizeof(resume)) {
+            return -1;
+        }
+        *id = ((uint64_t) ntohl(resume.idHigh) << 32) | ntohl(resume.idLow);
+        *offset = ((uint64_t) ntohl(resume.offsetHigh) << 32) | ntohl(resume.offsetLow);
+        *sum = ntohl(resume.checksum);
+
+        if (*offset > declared || otp_job_resume(*id, mode, declared, *offset, *sum) < 0) {
+            sendStatus(sockfd, OTP_BAD_RESUME);
+            return 1;
+        }
+        // The chunks follow, the request goes on.
+        if (otp_write_full(sockfd, &status, 1) < 0) {
+            return -1;
+        }
+    } else if (flags & OTP_FLAG_RESUMABLE) {
+        *id = otp_job_create(mode, declared);
+        reply.idHigh = htonl((uint32_t) (*id >> 32));
+        reply.idLow = htonl((uint32_t) *id);
+
+        iov[0].iov_base = &status;
+        iov[0].iov_len = 1;
+        iov[1].iov_base = &reply;
+        iov[1].iov_len = sizeof(reply);
+        if (otp_writev_full(sockfd, iov, 2) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*******************************************************
+ * otp_worker_serve(): Serve one connection. It runs in *
+ *                     the child process forked by      *
+ *                     otp_server_run() and serves      *
+ *                     requests until the client closes *
+ *                     the connection. Its return value *
+ *                     is the exit status of the child. *
+ ******************************************************/
+int otp_worker_serve(const struct otp_server *srv, int sockfd) {
+
+    // Declare variables.
+    int i;
+    int result;
+    int numFds;
+    int fds[OTP_MAX_FDS];
+    size_t size, length;
+    uint32_t mode, flags;
+    uint64_t offset;
+    uint64_t declared;
+    uint64_t jobId, lastJob = 0;
+    uint64_t seedStart;
+    uint32_t sum, lastSum;
+    unsigned char status;
+    struct iovec iov[2];
+    struct otp_seed seedMessage;
+    const struct otp_seed *seed;
+    char name[OTP_NAME_MAX];
+    char *textBuffer;
+    char *keyBuffer;
+    char *tempBuffer;
+
+    // Receive authentication message and reply.
+    if (otp_read_string(sockfd, name, sizeof(name)) < 0
+            || strcmp(name, srv->clientName) != 0) {
+        char response[]  = "invalid";
+        write(sockfd, response, sizeof(response));
+        _Exit(2);
+    }
+    // Write confirmation back to client.
+    otp_write_full(sockfd, srv->daemonName, strlen(srv->daemonName) + 1);
+
+    // Serve requests until the client closes the connection.
+    while (otp_recv_request(sockfd, &mode, &flags, &declared, fds, &numFds) == 1) {
+
+        // Time the request from the arrival of its header.
+        otp_capture_begin(mode, flags, declared);
+
+        // A new request means the client got all of the last job.
+        otp_job_finish(lastJob);
+        lastJob = 0;
+
+        // Reject the modes this daemon doesn't know, and file
+        // descriptors that don't come in a complete set.
+        if ((mode != OTP_MODE_BINARY && otp_alphabet(mode) == NULL)
+                || ((flags & OTP_FLAG_FILES)
+                    && numFds != ((flags & OTP_FLAG_SEED) ? OTP_MAX_FDS - 1 : OTP_MAX_FDS))) {
+            printf("ERROR(%s): unknown request mode %u\n", srv->name, mode);
+            sendStatus(sockfd, OTP_BAD_REQUEST);
+            return 1;
+        }
+        // The seed of the key comes right after the header.
+        seed = NULL;
+        if (flags & OTP_FLAG_SEED) {
+            if (otp_read_full(sockfd, &seedMessage, sizeof(seedMessage)) != sizeof(seedMessage)) {
+                return 2;
+            }
+            seed = &seedMessage;
+            seedStart = ((uint64_t) ntohl(seed->offsetHigh) << 32) | ntohl(seed->offsetLow);
+
+            if (seedStart > OTP_SEED_MAX_LENGTH || declared > OTP_SEED_MAX_LENGTH - seedStart) {
+                printf("ERROR(%s): request goes past the end of its seed\n", srv->name);
+                sendStatus(sockfd, OTP_BAD_REQUEST);
+                return 1;
+            }
+        }
+        if (flags & OTP_FLAG_FILES) {
+            result = serveFiles(srv, sockfd, mode, declared, fds, seed);
+            for (i = 0; i < numFds; i++) {
+                close(fds[i]);
+            }
+            if (result != 0) {
+                return result;
+            }
+            continue;
+        }
+        // Descriptors nobody asked for.
+        for (i = 0; i < numFds; i++) {
+            close(fds[i]);
+        }
+        // Start or resume a job the client may come back to.
+        result = startJob(sockfd, mode, flags, declared, &jobId, &offset, &sum);
+        if (result < 0) {
+            return 2;
+        }
+        if (result > 0) {
+            continue;
+        }
+        // Take buffers sized after the request from the pool.
+        size = declared < OTP_CHUNK ? declared : OTP_CHUNK;
+        textBuffer = otp_buf_get(size);
+        keyBuffer = otp_buf_get(size);
+        tempBuffer = otp_buf_get(size);
+
+        if (textBuffer == NULL || keyBuffer == NULL || tempBuffer == NULL) {
+            printf("ERROR(%s): out of memory\n", srv->name);
+            return 2;
+        }
+        // Read, check and transform the text one chunk at a time.
+        for (; offset < declared; offset += length) {
+            length = declared - offset < OTP_CHUNK ? declared - offset : OTP_CHUNK;
+
+            // Read the text chunk and the matching key chunk, unless
+            // the key comes from a seed.
+            if (otp_read_full(sockfd, textBuffer, length) != (ssize_t) length
+                    || (seed == NULL
+                        && otp_read_full(sockfd, keyBuffer, length) != (ssize_t) length)) {
+                printf("Error: %s could not read %s on port %d\n", srv->name, srv->textName,
+                       srv->portno);
+                return 2;
+            }
+            otp_capture_chunk(textBuffer, seed == NULL ? keyBuffer : NULL, length);
+
+            // Wait for our turn, shortest request first, then validate
+            // the contents of the text and of the key and transform them.
+            otp_sched_admit(declared - offset);
+            status = validate(srv, mode, declared, textBuffer, seed == NULL ? keyBuffer : NULL,
+                              length);
+            if (status == OTP_OK) {
+                if (seed != NULL) {
+                    expandKey(mode, declared, seed, offset, keyBuffer, length);
+                }
+                transform(srv, mode, declared, textBuffer, keyBuffer, tempBuffer, length);
+            }
+            otp_sched_release();
+
+            if (status != OTP_OK) {
+                sendStatus(sockfd, status);
+                return 1;
+            }
+            // Write the status and the transformed text into the socket.
+            iov[0].iov_base = &status;
+            iov[0].iov_len = 1;
+            iov[1].iov_base = tempBuffer;
+            iov[1].iov_len = length;
+
+            // Check for writing errors.
+            if (otp_writev_full(sockfd, iov, 2) < 0) {
+                printf("ERROR(%s): writing to socket failed!\n", srv->name);
+                return 2;
+            }
+            // Checkpoint the job. The client sent this chunk, so it has
+            // all the output before it. Stop if the job was resumed
+            // on another connection.
+            if (jobId != 0) {
+                lastSum = sum;
+                sum = otp_checksum(sum, tempBuffer, length);
+                if (otp_job_checkpoint(jobId, offset, lastSum, offset + length, sum) < 0) {
+                    return 2;
+                }
+            }
+        }
+        lastJob = jobId;
+        otp_capture_end(OTP_OK);
+        otp_sched_finish(declared);
+
+        // Keep the buffers warm for the next request.
+        otp_buf_put(textBuffer, size);
+        otp_buf_put(keyBuffer, size);
+        otp_buf_put(tempBuffer, size);
+    }
+    return 0;
+}
@@ -12,9 +12,61 @@
  **              commands: exit, cd, and status, as well as comments,      *
  **              which are lines beginning with the # character.           *
  **                                                                        *
+ **              Commands can be chained with | into a pipeline: every     *
+ **              command runs at the same time, its standard output        *
+ **              connected to the standard input of the next one by a      *
+ **              pipe. Redirections apply to the ends of the pipeline (<   *
+ **              to the first command, > to the last one), and & sends the *
+ **              whole pipeline to the background.                         *
+ **                                                                        *
+ **              The path of every command found in PATH is cached, so     *
+ **              running it again doesn't search PATH. The hash built in   *
+ **              command lists the cache, and hash -r empties it.          *
+ **                                                                        *
+ **              Background pipelines, and foreground ones stopped by a    *
+ **              signal, are kept in a job table updated when SIGCHLD      *
+ **              arrives. The jobs built in command lists them, wait waits *
+ **              for them, and fg and bg resume them. At a terminal, each  *
+ **              pipeline runs in a process group of its own, which gets   *
+ **              the terminal while in the foreground: ^Z stops it, not    *
+ **              the shell, and ^C reaches a job brought back with fg.     *
+ **                                                                        *
+ **              Usage: smallsh [-e] [-t file] [script | -c commands].     *
+ **              script file, or the commands to run with -c, the shell    *
+ **              runs them without prompting, and its output is written    *
+ **              out in batches. With -e, it stops at the first command    *
+ **              that fails. At the end of the input, the shell exits with *
+ **              the status of the last command.                           *
+ **                                                                        *
+ **              The time built in command runs the rest of the line and   *
+ **              reports the wall time, CPU time, max RSS, context         *
+ **              switches and page faults of its commands. With -t file,   *
+ **              the same is logged to file for every command.             *
+ **                                                                        *
+ **              parallel [-j N] command [args] ::: args runs the command  *
+ **              once for each argument after :::, with at most N of them  *
+ **              (by default, one per CPU) at the same time, and reports   *
+ **              how many failed and how long it took.                     *
+ **                                                                        *
+ **              echo, true, false, pwd, test ([) and cat run in the shell *
+ **              itself, without a child, when they are a whole foreground *
+ **              command. Their redirections are opened by the shell.      *
+ **                                                                        *
+ **              The cgroup built in command keeps jobs apart in cgroup v2 *
+ **              groups of their own, with CPU weight, memory and I/O      *
+ **              limits: cgroup NAME file=value... sets up a named group,  *
+ **              cgroup -e NAME runs the rest of the line in it, and       *
+ **              cgroup -j file=value... gives every background job a new  *
+ **              group. jobs shows what each job's group used.             *
+ **                                                                        *
+ **              stats {-rows|-cols} [file] prints the average and median  *
+ **              of each row or column of numbers, as the stats script     *
+ **              does, without a process per row. In a pipeline or in the  *
+ **              background, it runs in a child of the shell.              *
  **************************************************************************/
 
 // Define Libraries
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,111 +76,367 @@
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <sys/signalfd.h>
+#include <sys/sendfile.h>
+#include <dirent.h>
 #define SIZE 513
+#define HASH_SIZE 64        // buckets of the command path cache.
+#define PID_HASH_SIZE 1024  // buckets of the processes of the jobs.
+
+// Numbers of a row or column for stats: their sum, and the numbers
+// themselves for the median.
+struct values {
+    long long* data;
+    size_t count;
+    size_t capacity;
+    long long sum;
+};
 
 // Function Prototypes/definitions.
 void killProcess(void);
 char *read_input(void);
+int loadScript(char* path);
+char *readAll(int fd, size_t* size, int* isMapped);
+void flushOutput(void);
 void printStatus(int status);
-void finishProcesses(pid_t pid);
+void addUsage(struct rusage* total, struct rusage* usage);
+double elapsedSince(struct timespec* start);
+void printUsage(double elapsed, struct rusage* usage);
+void logUsage(char* command, double elapsed, struct rusage* usage, int childStatus);
+char *joinCommands(char** cmds[SIZE], int numCmds);
+int finishProcesses(void);
 void tokenize(char* input, char* args[SIZE], int isFore);
-void freePointers(char* args[SIZE], char* fileIn, char* fileOut);
-void buildInCommands(char* args[SIZE], char* fileIn, char* fileOut, int isFore);
-void execute(char* args[SIZE], char* fileIn, char* fileOut, int isFore);
+void buildInCommands(char** cmds[SIZE], int numCmds, char* fileIn, char* fileOut, int isFore);
+void execute(char** cmds[SIZE], int numCmds, char* fileIn, char* fileOut, int isFore);
+pid_t spawnChild(char* args[SIZE], char* fileIn, char* fileOut, int inPipe, int outPipe, int isFore, pid_t group);
+pid_t forkStats(char* args[SIZE], int in_descriptor, int out_descriptor, int isFore, pid_t group);
+unsigned hashIndex(char* name);
+int findCommand(char* name, char* path);
+void forgetCommands(char* name);
+void hashCommand(char* args[SIZE]);
+int isFastCommand(char* args[SIZE], char* fileIn);
+void fastCommand(char* args[SIZE], char* fileIn, char* fileOut);
+int testExpression(char** args, int numArgs);
+int copyData(int from, int to);
+int statsCommand(char* args[SIZE], int in_descriptor, FILE* output);
+int nextValue(char** cursor, char* end, long long* value);
+int addValue(struct values* list, long long value);
+long long selectValue(long long* values, size_t numValues, size_t k);
+struct job *addJob(pid_t pids[SIZE], int numPids, char** cmds[SIZE], int numCmds);
+void removeJob(struct job* job);
+struct job *findJob(char* spec, char* name);
+struct job *updateJob(pid_t pid, int childStatus, struct rusage* childUsage, int notify);
+void continueJob(struct job* job);
+void waitJob(struct job* job, int notify);
+void jobCommands(char* args[SIZE]);
+void parallelArgs(char* args[SIZE], int first, int last, char* arg, char* jobArgs[SIZE]);
+void parallelCommand(char* args[SIZE], char* fileIn, char* fileOut);
+int setupCgroups(void);
+void removeCgroups(void);
+char *groupPath(char* name);
+int writeGroupFile(char* dir, char* file, char* value);
+int readGroupFile(char* dir, char* file, char* text, size_t size);
+int configureGroup(char* dir, char** settings);
+long long groupValue(char* dir, char* file, char* key);
+void printGroupUsage(char* dir);
+char *startGroup(int isFore);
+void cgroupCommand(char* args[SIZE]);
 
 // Declare sigaction function for signal handler.
 struct sigaction action;
 
+// Environment passed to the commands.
+extern char **environ;
+
 // A couple of global variables to make life easier ;-)
 int status = 0;             // keep current status output.
 int pidCounter = 0;         // counts how many processes have been created.
 
+// Cache of the full paths of the commands run so far, so PATH is
+// searched once per command rather than once per run.
+struct hashEntry {
+    char* name;             // command name.
+    char* path;             // where it was found in PATH.
+    int hits;               // times it was looked up.
+    struct hashEntry* next; // next entry in the same bucket.
+};
+struct hashEntry* hashTable[HASH_SIZE];
+char* hashedPath = NULL;    // PATH the cache was filled with.
+
+// Table of the jobs: the pipelines sent to the background with &,
+// and the foreground ones that got stopped. Its processes are found
+// by PID through a hash table, so a child changing state costs the
+// same however many jobs there are.
+struct job {
+    int id;                 // number given to jobs, fg, bg and wait.
+    char* command;          // command line, as shown by jobs.
+    pid_t* pids;            // processes of the pipeline, 0 once done.
+    int numPids;
+    int numLeft;            // processes not done yet.
+    int isStopped;          // stopped by a signal.
+    pid_t pgid;             // process group, or 0 outside a terminal.
+    int lastStatus;         // status of the last process once done.
+    struct timespec start;  // when it was started.
+    struct rusage usage;    // resources used by its processes done.
+    char* cgroup;           // cgroup it runs in, or NULL.
+    int ownsGroup;          // the cgroup was made for it (cgroup -j).
+    struct job* prev;       // jobs in order of id.
+    struct job* next;
+};
+struct jobProcess {
+    pid_t pid;
+    struct job* job;
+    struct jobProcess* next; // next process in the same bucket.
+};
+struct job* firstJob = NULL;
+struct job* lastJob = NULL;
+struct jobProcess* processTable[PID_HASH_SIZE];
+int sigchldFd = -1;         // signalfd reporting SIGCHLD.
+int numNotices = 0;         // state changes updateJob() printed.
+char* lineBuffer = NULL;    // input line, reused for every line.
+size_t lineSize = 0;        // size of lineBuffer.
+int interactive = 0;        // the input comes from a terminal.
+pid_t shellGroup = 0;       // process group of the shell, at a terminal.
+char* script = NULL;        // script being run, or NULL to read stdin.
+size_t scriptSize = 0;
+size_t scriptOffset = 0;    // where the next line of the script starts.
+int stopOnError = 0;        // exit once a command fails (-e).
+struct rusage usage;        // resources used by the commands waited for, for time.
+FILE* logFile = NULL;       // where every command's usage is logged (-t).
+
+// The cgroups of the jobs are made under the one the shell started
+// in (cgroupBase), in a group of its own (cgroupTop) which holds the
+// shell itself in "shell", the named groups, and "job-N" for job N.
+char* cgroupBase = NULL;
+char* cgroupTop = NULL;     // NULL until the cgroup command is used.
+char* cgroupShell = NULL;
+char** jobSettings = NULL;  // settings of the group of each background job (cgroup -j).
+char* runGroup = NULL;      // group the commands start in (cgroup -e).
+
 /***********************************************************
 * tokenize(): Function to parse and tokenize user's input. *
+*             The tokens are cut out of the input itself,  *
+*             so nothing is allocated: each one is copied  *
+*             over itself without its quotes and escapes   *
+*             (never longer than it was) and ended with a  *
+*             NUL. Text between single quotes is taken as  *
+*             it is. Between double quotes, a backslash    *
+*             only escapes \, ", $ and `. Elsewhere, it    *
+*             escapes any character. A quoted <, >, | or & *
+*             is an argument, not an operator.             *
 ***********************************************************/
 void tokenize(char* input, char* args[SIZE], int isFore) {
 
     // Set local variables.
     char* token;
+    char* read = input;     // next character to parse.
+    char* write = input;    // where the token being parsed goes.
+    char quote;             // quote the token is in, or 0.
+    int isQuoted;           // the token had quotes or escapes.
     int position = 0;
     char* fileIn = NULL;    // input file name
     char* fileOut = NULL;   // output file name
-    
-    //tokenize very first argument.
-    token = strtok(input, " \n");
-    
-    while (token != NULL) {
-        // Set token as the input file name when "<".
-        if (strcmp(token, "<") == 0) {
-            token = strtok(NULL, " \n");
-            fileIn = strdup(token);
-            token = strtok(NULL, " \n");
-            
-        // Set token as the output file name when ">".
-        } else if (strcmp(token, ">") == 0) {
-            token = strtok(NULL, " \n");
-            fileOut = strdup(token);
-            token = strtok(NULL, " \n");
-            
+    char** target = NULL;   // file name expected after < or >.
+    char** cmds[SIZE];      // first argument of each command of the pipeline.
+    int numCmds = 1;        // commands in the pipeline.
+
+    // The first command starts at the beginning of args.
+    cmds[0] = args;
+
+    // Leave room for the NULL ending every command.
+    while (position < SIZE - 1) {
+        // Skip the blanks before the token. A line whose first
+        // word starts with # is a comment.
+        while (*read == ' ' || *read == '\t' || *read == '\n') {
+            ++read;
+        }
+        if (*read == '\0' || (*read == '#' && position == 0 && numCmds == 1 && target == NULL)) {
+            break;
+        }
+        token = write;
+        quote = 0;
+        isQuoted = 0;
+        while (*read != '\0' && (quote != 0 || (*read != ' ' && *read != '\t' && *read != '\n'))) {
+            if (quote == '\'') {
+                if (*read != '\'') {
+                    *write++ = *read;
+                } else {
+                    quote = 0;
+                }
+                ++read;
+            } else if (*read == '\\' && read[1] != '\0'
+                       && (quote == 0 || strchr("\\\"$`", read[1]) != NULL)) {
+                *write++ = read[1];
+                read += 2;
+                isQuoted = 1;
+            } else if (*read == '"') {
+                quote = quote == 0 ? '"' : 0;
+                ++read;
+                isQuoted = 1;
+            } else if (*read == '\'' && quote == 0) {
+                quote = '\'';
+                ++read;
+                isQuoted = 1;
+            } else {
+                *write++ = *read++;
+            }
+        }
+        if (quote != 0) {
+            printf("Error: unterminated quote\n");
+            flushOutput();
+            status = 256;   // exit value 1.
+            return;
+        }
+        // Step over the blank ending the token before ending it
+        // with NUL, it may be right where the NUL goes.
+        if (*read != '\0') {
+            ++read;
+        }
+        *write++ = '\0';
+
+        // Set token as the input or output file name after "<" or ">".
+        if (target != NULL) {
+            *target = token;
+            target = NULL;
+
+        } else if (!isQuoted && strcmp(token, "<") == 0) {
+            target = &fileIn;
+
+        } else if (!isQuoted && strcmp(token, ">") == 0) {
+            target = &fileOut;
+
         // Set the command as a background process.
-        } else if (strcmp(token, "&") == 0) {
+        } else if (!isQuoted && strcmp(token, "&") == 0) {
             isFore = 0;
             break;
-            
+
+        // End the command with NULL and start the next one of
+        // the pipeline right after it.
+        } else if (!isQuoted && strcmp(token, "|") == 0) {
+            args[position] = NULL;
+            ++position;
+            cmds[numCmds] = &args[position];
+            ++numCmds;
+
         // This token will be the command name or argument.
         } else {
-            args[position] = strdup(token);
-            token = strtok(NULL, " \n");
+            args[position] = token;
             ++position;
         }
     }
+    if (target != NULL) {
+        printf("Error: missing file name after %s\n", target == &fileIn ? "<" : ">");
+        flushOutput();
+        status = 256;   // exit value 1.
+        return;
+    }
     // Set the very last array element to NULL so the
     // program can detect the end of the input string.
     args[position] = NULL;
-    
+
     // Call function to run build-in commands.
-    buildInCommands(args, fileIn, fileOut, isFore);
+    buildInCommands(cmds, numCmds, fileIn, fileOut, isFore);
 };
 
 /*************************************************************
 * killProcess(): Function to kill any other processes or     *
 *                jobs that your shell has started before     *
 *                it terminates itself, when the EXIT command *
-*                is run.                                     *
+*                is run. Every process left in the job table *
+*                is killed and then reaped.                  *
 *************************************************************/
 void killProcess() {
-    
-    // Get pid of first waiting process.
-    pid_t pid = waitpid(-1, &status, WNOHANG);
-    
+
+    struct job* job;
+    int i;
+
     // Kill all pending processes.
-    while (pid > 0) {
-        if ((kill(pid, SIGKILL)) > 0) {
-            //printf("Process %i has been killed!\n", pid);
-            pid = waitpid(-1, &status, WNOHANG);
+    for (job = firstJob; job != NULL; job = job->next) {
+        for (i = 0; i < job->numPids; i++) {
+            if (job->pids[i] != 0) {
+                kill(job->pids[i], SIGKILL);
+                waitpid(job->pids[i], NULL, 0);
+            }
         }
     }
-    kill(0, SIGTERM); // double check everything was killed!
+    // Their cgroups can go now.
+    removeCgroups();
 };
 
 /**************************************************************
-* buildInCommands(): Function to run the three built-in       *
-*                    commands: exit, cd, and status. These 3  *
-*                    built-in commands are the only ones that *
-*                    the shell handles itself. This function  *
-*                    also handles blank spaces or comments    *
-*                    when they are entered by the user.       *
+* buildInCommands(): Function to run the built-in commands:   *
+*                    exit, cd, status, hash, jobs, wait, fg,  *
+*                    bg, time, parallel and cgroup. The shell *
+*                    also runs a few common utilities itself  *
+*                    (see fastCommand()). This function also  *
+*                    handles blank spaces or comments when    *
+*                    they are entered by the user. Pipelines  *
+*                    always go to execute().                  *
 **************************************************************/
-void buildInCommands(char* args[SIZE], char* fileIn, char* fileOut, int isFore) {
-    
-    int exec; // Dummy variable.
-    
+void buildInCommands(char** cmds[SIZE], int numCmds, char* fileIn, char* fileOut, int isFore) {
+
+    int exec;                   // Dummy variable.
+    int i;
+    char** args = cmds[0];      // first command of the pipeline.
+    struct timespec start;      // when time started the line.
+    char* group;                // group the line runs in before cgroup -e.
+
+    // Check if the user wants to time the rest of the line. It
+    // runs like any other line, then what it used is reported.
+    if (args[0] != NULL && strcmp(args[0], "time") == 0) {
+        memset(&usage, 0, sizeof(usage));
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        cmds[0] = &args[1];
+        buildInCommands(cmds, numCmds, fileIn, fileOut, isFore);
+        printUsage(elapsedSince(&start), &usage);
+        return;
+    }
+    // Check if the user wants to run the rest of the line in a
+    // cgroup: its commands start in it.
+    if (args[0] != NULL && strcmp(args[0], "cgroup") == 0 && args[1] != NULL && strcmp(args[1], "-e") == 0) {
+        if (args[2] == NULL || strchr(args[2], '/') != NULL || args[2][0] == '.') {
+            printf("Usage: cgroup -e name command [args]\n");
+            flushOutput();
+            status = 256;   // exit value 1.
+        } else if (setupCgroups() == 0) {
+            group = runGroup;
+            runGroup = args[2];
+            cmds[0] = &args[3];
+            buildInCommands(cmds, numCmds, fileIn, fileOut, isFore);
+            runGroup = group;
+        } else {
+            status = 256;   // exit value 1.
+        }
+        return;
+    }
+
     // Check if the input is a blank line or a comment.
-    if (args[0] == NULL||*(args[0]) == '#'||*(args[0]) == ' ') {
+    if ((args[0] == NULL && numCmds == 1)||(args[0] != NULL && (*(args[0]) == '#'||*(args[0]) == ' '))) {
         // Do nothing. Just reprint cursor and give a
         // a value to the dummy variable.
         exec = 0;
-        
+
+    // Every command of a pipeline needs a name.
+    } else if (numCmds > 1) {
+        for (i = 0; i < numCmds && cmds[i][0] != NULL; i++) {
+            continue;
+        }
+        if (i < numCmds) {
+            printf("Error: missing command in pipeline\n");
+            flushOutput();
+            status = 256;   // exit value 1.
+        } else {
+            execute(cmds, numCmds, fileIn, fileOut, isFore);
+        }
+
     // Check if the user wants to see the exit status or
     // the terminating signal of the last foreground process.
     } else if (strcmp(args[0], "status") == 0) {
@@ -144,20 +452,48 @@ void buildInCommands(char* args[SIZE], char* fileIn, char* fileOut, int isFore)
         } else {
             chdir(args[1]);
         }
+
+    // Check if the user wants to list, wait for, or resume
+    // the jobs.
+    } else if (strcmp(args[0], "jobs") == 0 || strcmp(args[0], "wait") == 0
+               || strcmp(args[0], "fg") == 0 || strcmp(args[0], "bg") == 0) {
+        jobCommands(args);
+
+    // Check if the user wants to run a command for many
+    // arguments, a few at a time.
+    } else if (strcmp(args[0], "parallel") == 0) {
+        parallelCommand(args, fileIn, fileOut);
+
+    // Check if the user wants to set up cgroups or run
+    // commands in them.
+    } else if (strcmp(args[0], "cgroup") == 0) {
+        cgroupCommand(args);
+
+    // Check if the user wants to see or empty the cache of
+    // command paths.
+    } else if (strcmp(args[0], "hash") == 0) {
+        hashCommand(args);
+
     // Check if the user wants to kill all processes or jobs
     // that your shell has started before and exit from the shell.
     } else if (strcmp(args[0], "exit") == 0) {
-        // Free active pointers.
-        freePointers(args, fileIn, fileOut);
+        forgetCommands(NULL);
+        free(hashedPath);
+        free(lineBuffer);
         // Kill all children processes.
         killProcess();
         // Exit the shell.
         exit(0);
+
+    // Check if it's a common utility the shell can run itself,
+    // without starting a process.
+    } else if (numCmds == 1 && isFore == 1 && isFastCommand(args, fileIn)) {
+        fastCommand(args, fileIn, fileOut);
     
     // Execute any command other than the build-ins commands.
     } else {
         // Call function to execute non build-in commands.
-        execute(args, fileIn, fileOut, isFore);
+        execute(cmds, numCmds, fileIn, fileOut, isFore);
     }
 };
 
@@ -178,204 +514,2405 @@ void printStatus(int status) {
 };
 
 /*********************************************************
-* execute(): Function to execute the input commands and  *
-*            arguments. It also performs the piping      *
-*            process and handles of the input/output     *
-*            file redirection.                           *
+* addUsage(): Function to add the resources a process    *
+*             used to the total. Times, context switches *
+*             and page faults add up, and the max RSS is *
+*             the one of the biggest process.            *
 *********************************************************/
-void execute(char* args[SIZE], char* fileIn, char* fileOut, int isFore) {
+void addUsage(struct rusage* total, struct rusage* usage) {
 
-    int in_descriptor = -1;     // input file descriptor.
-    int out_descriptor = -1;    // output file descriptor.
-    pid_t pidArray[SIZE];       // store PIDs of the processes created.
-    pid_t pid;                  // store current PID.
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss) {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+    total->ru_minflt += usage->ru_minflt;
+    total->ru_majflt += usage->ru_majflt;
+};
 
-    // Call fork() to start the parent and child processes
-    pid = fork();
-    
-    // Save most recent pid in the array designated to
-    // keep the pid of all processes.
-    pidArray[pidCounter] = pid;
-    pidCounter++; // Increment pid counter.
-
-    // Child Process: This process does any needed input/output redirection
-    // before running exec() on the command given. It uses dup2() to set up
-    // the redirection. The redirection symbol and redirection destination
-    // and/or source are NOT passed into the following exec command.
-    if (pid == 0) {
-        // If it's a foreground process, set the signal handler to
-        // default so the foreground commands can be interrupted.
-        if (isFore == 1) {
-            // Set the default action for the signal handler.
-            action.sa_handler = SIG_DFL;
-            sigaction(SIGINT, &action, NULL);
-            
-        // If it's a background process, make sure it doesn't send
-        // its standard output to the screen.
+/*********************************************************
+* elapsedSince(): Function to get the seconds since      *
+*                 start, on the monotonic clock.         *
+*********************************************************/
+double elapsedSince(struct timespec* start) {
+
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+};
+
+/*********************************************************
+* printUsage(): Function to print out what the time      *
+*               built-in command measured. It goes to    *
+*               standard error, like sh does, so it      *
+*               doesn't mix with the output of a script. *
+*********************************************************/
+void printUsage(double elapsed, struct rusage* usage) {
+
+    fflush(stdout);
+    fprintf(stderr, "real\t%.3fs\n", elapsed);
+    fprintf(stderr, "user\t%ld.%03lds\n", (long) usage->ru_utime.tv_sec, (long) usage->ru_utime.tv_usec / 1000);
+    fprintf(stderr, "sys\t%ld.%03lds\n", (long) usage->ru_stime.tv_sec, (long) usage->ru_stime.tv_usec / 1000);
+    fprintf(stderr, "maxrss\t%ld KB\n", usage->ru_maxrss);
+    fprintf(stderr, "csw\t%ld voluntary, %ld involuntary\n", usage->ru_nvcsw, usage->ru_nivcsw);
+    fprintf(stderr, "faults\t%ld minor, %ld major\n", usage->ru_minflt, usage->ru_majflt);
+};
+
+/*********************************************************
+* logUsage(): Function to log what a finished command    *
+*             line used to the -t file: one line of tab  *
+*             separated fields, in the order of the      *
+*             header written when the file was empty.    *
+*             The status is the exit value, or 128 plus  *
+*             the signal, as sh shows it.                *
+*********************************************************/
+void logUsage(char* command, double elapsed, struct rusage* usage, int childStatus) {
+
+    fprintf(logFile, "%.3f\t%ld.%03ld\t%ld.%03ld\t%ld\t%ld\t%ld\t%ld\t%ld\t%i\t%s\n",
+            elapsed, (long) usage->ru_utime.tv_sec, (long) usage->ru_utime.tv_usec / 1000,
+            (long) usage->ru_stime.tv_sec, (long) usage->ru_stime.tv_usec / 1000,
+            usage->ru_maxrss, usage->ru_nvcsw, usage->ru_nivcsw, usage->ru_minflt,
+            usage->ru_majflt, WIFEXITED(childStatus) ? WEXITSTATUS(childStatus) : 128 + WTERMSIG(childStatus),
+            command);
+};
+
+/*********************************************************
+* hashIndex(): Function to pick the bucket of a command  *
+*              name in the command path cache.           *
+*********************************************************/
+unsigned hashIndex(char* name) {
+
+    unsigned hash = 5381;
+
+    while (*name != '\0') {
+        hash = hash * 33 + (unsigned char) *name;
+        ++name;
+    }
+    return hash % HASH_SIZE;
+};
+
+/*********************************************************
+* forgetCommands(): Function to drop the cached path of  *
+*                   the command name, or of every        *
+*                   command when name is NULL.           *
+*********************************************************/
+void forgetCommands(char* name) {
+
+    struct hashEntry** link;
+    struct hashEntry* entry;
+    int i;
+
+    for (i = 0; i < HASH_SIZE; i++) {
+        link = &hashTable[i];
+        while (*link != NULL) {
+            entry = *link;
+            if (name == NULL || strcmp(entry->name, name) == 0) {
+                *link = entry->next;
+                free(entry->name);
+                free(entry->path);
+                free(entry);
+            } else {
+                link = &entry->next;
+            }
+        }
+    }
+};
+
+/*********************************************************
+* findCommand(): Function to find the full path of the   *
+*                command name and copy it to path, from  *
+*                the cache or else by searching PATH the *
+*                way execvp() does. A name with a / is   *
+*                used as it is. The cache is emptied     *
+*                when PATH changes. Returns -1 if the    *
+*                command isn't found.                    *
+*********************************************************/
+int findCommand(char* name, char* path) {
+
+    char* search = getenv("PATH");
+    char* dir;
+    char* end;
+    size_t dirLength;
+    struct hashEntry* entry;
+    struct stat info;
+    unsigned index;
+
+    if (strchr(name, '/') != NULL) {
+        snprintf(path, PATH_MAX, "%s", name);
+        return 0;
+    }
+    // Same default as execvp() when PATH is not set.
+    if (search == NULL) {
+        search = "/bin:/usr/bin";
+    }
+    // The cache only holds for the PATH it was filled with.
+    if (hashedPath == NULL || strcmp(hashedPath, search) != 0) {
+        forgetCommands(NULL);
+        free(hashedPath);
+        hashedPath = strdup(search);
+    }
+    index = hashIndex(name);
+    for (entry = hashTable[index]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            entry->hits++;
+            snprintf(path, PATH_MAX, "%s", entry->path);
+            return 0;
+        }
+    }
+    // Try every directory of PATH in order. An empty one stands
+    // for the current directory.
+    for (dir = search; ; dir = end + 1) {
+        end = strchr(dir, ':');
+        if (end == NULL) {
+            end = dir + strlen(dir);
+        }
+        dirLength = end - dir;
+        if (dirLength == 0) {
+            snprintf(path, PATH_MAX, "%s", name);
         } else {
-            // Standard input redirected from /dev/null if the user didn't
-            // specify some other file to take standard input from.
-            in_descriptor = open("/dev/null", O_RDONLY);
-            if (in_descriptor == -1) {
-                perror("open");  //display error.
-                _Exit(1);
-            }
-            // Replace standard input with "/dev/null" and check for error.
-            if (dup2(in_descriptor, 0) == -1) {
-                perror("dup2");  //display error.
-                _Exit(1);
-            }
-        }
-        //handle input redirection
-        if (fileIn != NULL) {
-            // open input file and check for error.
-            in_descriptor = open(fileIn, O_RDONLY); //set file to be read.
-            if (in_descriptor == -1) { //check opening error.
-                printf("Error: cannot open %s for input\n", fileIn);
-                fflush(stdout);
-                _Exit(1);
-            }
-            // Replace standard input with input file and check for error.
-            if (dup2(in_descriptor, 0) == -1) {
-                perror("dup2");
-                _Exit(1);
+            snprintf(path, PATH_MAX, "%.*s/%s", (int) dirLength, dir, name);
+        }
+        if (stat(path, &info) == 0 && S_ISREG(info.st_mode) && access(path, X_OK) == 0) {
+            // Only absolute paths stay right after a cd.
+            if (path[0] == '/' && (entry = malloc(sizeof(struct hashEntry))) != NULL) {
+                entry->name = strdup(name);
+                entry->path = strdup(path);
+                entry->hits = 1;
+                entry->next = hashTable[index];
+                hashTable[index] = entry;
             }
-            close(in_descriptor);
-        //handle output redirection
-        } else if (fileOut != NULL) {
-            // open output file and check for error.
-            out_descriptor = open(fileOut, O_WRONLY | O_CREAT | O_TRUNC, 0744);
-            if (out_descriptor == -1) {
-                printf("Error: cannot open %s for output\n", fileOut);
-                fflush(stdout);
-                _Exit(1);
-            }
-            // Replace standard output with output file and check for error.
-            if (dup2(out_descriptor, 1) == -1) {
-                perror("dup2");
-                _Exit(1);
+            return 0;
+        }
+        if (*end == '\0') {
+            return -1;
+        }
+    }
+};
+
+/*********************************************************
+* hashCommand(): Function to run the hash built-in       *
+*                command. With no argument, it lists the *
+*                cached paths and their hits. With -r,   *
+*                it empties the cache. Otherwise, it     *
+*                finds and caches each command given.    *
+*********************************************************/
+void hashCommand(char* args[SIZE]) {
+
+    char path[PATH_MAX];
+    struct hashEntry* entry;
+    int i, numEntries = 0;
+
+    if (args[1] == NULL) {
+        for (i = 0; i < HASH_SIZE; i++) {
+            for (entry = hashTable[i]; entry != NULL; entry = entry->next) {
+                if (numEntries == 0) {
+                    printf("hits\tcommand\n");
+                }
+                printf("%4i\t%s\n", entry->hits, entry->path);
+                ++numEntries;
             }
-            close(out_descriptor);
         }
-        //execute the command/arguments and check for error.
-        if (execvp(args[0], args)) {
-            printf("Error: command \"%s\" not found\n", args[0]);
-            fflush(stdout);
-            _Exit(1);
+        if (numEntries == 0) {
+            printf("hash: hash table empty\n");
         }
-    // Check if there was an error with fork()
-    } else if (pid < 0) {
-        perror("fork");
-        status = 1;
-    
-    // Parent Process (shell): It runs continuously. Whenever a
-    // non-built in command is received, it forks off a child.
+    } else if (strcmp(args[1], "-r") == 0) {
+        forgetCommands(NULL);
     } else {
-        if (isFore == 1) {
-            // Wait for completion of foreground commands before
-            // prompting for the next command..
-            waitpid(pid, &status, 0);
-        } else {
-            // Otherwise, it's a background process. So print the
-            // pid of the background process.
-            printf("background pid is %i\n", pid);
+        for (i = 1; args[i] != NULL; i++) {
+            if (findCommand(args[i], path) == -1) {
+                printf("hash: %s: not found\n", args[i]);
+            }
         }
     }
-    // Call function to free memory designated to pointer variables.
-    freePointers(args, fileIn, fileOut);
-    // Call function to check for finished background processes.
-    finishProcesses(pid);
+    flushOutput();
 };
 
-/****************************************************************
-* read_input(): Function to read user's input                   *
-****************************************************************/
-char *read_input(void) {
-    char *input = NULL;
-    ssize_t bufsize = 0; // have getline allocate a buffer.
-    getline(&input, &bufsize, stdin);
-    return input; // Return processed input.
+/*********************************************************
+* isFastCommand(): Function to tell if the command is    *
+*                  one fastCommand() runs: echo with no  *
+*                  option but -n, true, false, pwd with  *
+*                  no option, test or [, stats, and cat  *
+*                  with no option. A cat that would read *
+*                  the terminal is left to the real one, *
+*                  so it can be interrupted.             *
+*********************************************************/
+int isFastCommand(char* args[SIZE], char* fileIn) {
+
+    int readsStdin;
+    int i;
+
+    if (strcmp(args[0], "true") == 0 || strcmp(args[0], "false") == 0
+        || strcmp(args[0], "test") == 0 || strcmp(args[0], "[") == 0 || strcmp(args[0], "stats") == 0) {
+        return 1;
+    }
+    if (strcmp(args[0], "pwd") == 0) {
+        return args[1] == NULL;
+    }
+    if (strcmp(args[0], "echo") == 0) {
+        for (i = 1; args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+            if (strcmp(args[i], "-n") != 0) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    if (strcmp(args[0], "cat") == 0) {
+        readsStdin = args[1] == NULL;
+        for (i = 1; args[i] != NULL; i++) {
+            if (strcmp(args[i], "-") == 0) {
+                readsStdin = 1;
+            } else if (args[i][0] == '-') {
+                return 0;
+            }
+        }
+        return !readsStdin || fileIn != NULL || !isatty(0);
+    }
+    return 0;
 };
 
-/*****************************************************************
-* freePointers(): Function to free the char pointers, which are  *
-*                 going to be reused by the shell in the future. *
-*****************************************************************/
-void freePointers(char* args[SIZE], char* fileIn, char* fileOut) {
+/*********************************************************
+* fastCommand(): Function to run echo, true, false, pwd, *
+*                test ([), stats or cat in the shell     *
+*                itself, which costs nothing next to     *
+*                starting a process. The shell opens the *
+*                input and output files. Output to the   *
+*                standard output goes through its        *
+*                buffer, so it stays in order with the   *
+*                rest. cat copies with copy_file_range() *
+*                or sendfile() when it can, so the data  *
+*                doesn't go through the shell.           *
+*********************************************************/
+void fastCommand(char* args[SIZE], char* fileIn, char* fileOut) {
 
+    int in_descriptor = 0;      // input file descriptor.
+    int out_descriptor = 1;     // output file descriptor.
+    FILE* output = stdout;
+    char path[PATH_MAX];
+    char** cmds[SIZE];          // the command as a pipeline, for the log.
+    char* command;
+    struct timespec start;      // when the command was started.
+    struct rusage before, used; // the shell's usage before, and the command's.
+    int exitValue = 0;
+    int first;                  // first argument echo prints.
+    int from;
+    int numArgs;
     int i;
-    // Free char array created to store arguments or commands.
-    for (i = 0; args[i] != NULL; ++i) {
-        free(args[i]);
+
+    // What the command uses is what the shell uses meanwhile.
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    getrusage(RUSAGE_SELF, &before);
+
+    //handle input redirection
+    if (fileIn != NULL) {
+        in_descriptor = open(fileIn, O_RDONLY | O_CLOEXEC);
+        if (in_descriptor == -1) {
+            printf("Error: cannot open %s for input\n", fileIn);
+            flushOutput();
+            status = 256;   // exit value 1.
+            return;
+        }
+    }
+    //handle output redirection
+    if (fileOut != NULL) {
+        out_descriptor = open(fileOut, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0744);
+        if (out_descriptor == -1 || (output = fdopen(out_descriptor, "w")) == NULL) {
+            printf("Error: cannot open %s for output\n", fileOut);
+            flushOutput();
+            if (out_descriptor != -1) {
+                close(out_descriptor);
+            }
+            if (in_descriptor != 0) {
+                close(in_descriptor);
+            }
+            status = 256;   // exit value 1.
+            return;
+        }
     }
-    // Free input and output file-names variables.
-    free(fileIn);
-    fileIn = NULL;
-    free(fileOut);
-    fileOut = NULL;
-};
 
-/****************************************************************
-* finishProcesses(): Function to check for finished background  *
-*                    processes and print out their PIDs.        *
-****************************************************************/
-void finishProcesses(pid_t pid) {
-    // Get pid of waiting/zombie processes.
-    pid = waitpid(-1, &status, WNOHANG);
-    
-    // Display the pid of the background processes.
-    while (pid > 0) {
-        printf("background pid %i is done: ", pid);
-        printStatus(status);
-        pid = waitpid(-1, &status, WNOHANG);
+    if (strcmp(args[0], "echo") == 0) {
+        for (first = 1; args[first] != NULL && strcmp(args[first], "-n") == 0; first++) {
+            continue;
+        }
+        for (i = first; args[i] != NULL; i++) {
+            fprintf(output, i > first ? " %s" : "%s", args[i]);
+        }
+        if (first == 1) {
+            fputc('\n', output);
+        }
+    } else if (strcmp(args[0], "false") == 0) {
+        exitValue = 1;
+    } else if (strcmp(args[0], "pwd") == 0) {
+        if (getcwd(path, sizeof(path)) != NULL) {
+            fprintf(output, "%s\n", path);
+        } else {
+            printf("pwd: %s\n", strerror(errno));
+            exitValue = 1;
+        }
+    } else if (strcmp(args[0], "test") == 0 || strcmp(args[0], "[") == 0) {
+        for (numArgs = 0; args[numArgs + 1] != NULL; numArgs++) {
+            continue;
+        }
+        if (args[0][0] == '[' && (numArgs == 0 || strcmp(args[numArgs], "]") != 0)) {
+            printf("[: missing ]\n");
+            exitValue = 2;
+        } else {
+            exitValue = testExpression(&args[1], args[0][0] == '[' ? numArgs - 1 : numArgs);
+        }
+    } else if (strcmp(args[0], "cat") == 0) {
+        for (i = 1; i == 1 || args[i] != NULL; i++) {
+            if (args[i] == NULL || strcmp(args[i], "-") == 0) {
+                from = in_descriptor;
+            } else if ((from = open(args[i], O_RDONLY | O_CLOEXEC)) == -1) {
+                printf("cat: %s: %s\n", args[i], strerror(errno));
+                exitValue = 1;
+                continue;
+            }
+            // What was printed before goes first.
+            fflush(stdout);
+            fflush(output);
+            if (copyData(from, out_descriptor) == -1) {
+                printf("cat: %s: %s\n", args[i] != NULL ? args[i] : "-", strerror(errno));
+                exitValue = 1;
+            }
+            if (from != in_descriptor) {
+                close(from);
+            }
+            if (args[i] == NULL) {
+                break;
+            }
+        }
+    } else if (strcmp(args[0], "stats") == 0) {
+        exitValue = statsCommand(args, in_descriptor, output);
+    }
+    // true has nothing to do.
+
+    if (output != stdout) {
+        if (fclose(output) == EOF) {
+            exitValue = 1;
+        }
+    } else {
+        flushOutput();
+    }
+    if (in_descriptor != 0) {
+        close(in_descriptor);
+    }
+    status = exitValue << 8;
+
+    // Count it for time and log it like a child. There is no max
+    // RSS of its own: the shell's is given.
+    getrusage(RUSAGE_SELF, &used);
+    timersub(&used.ru_utime, &before.ru_utime, &used.ru_utime);
+    timersub(&used.ru_stime, &before.ru_stime, &used.ru_stime);
+    used.ru_nvcsw -= before.ru_nvcsw;
+    used.ru_nivcsw -= before.ru_nivcsw;
+    used.ru_minflt -= before.ru_minflt;
+    used.ru_majflt -= before.ru_majflt;
+    addUsage(&usage, &used);
+    cmds[0] = args;
+    if (logFile != NULL && (command = joinCommands(cmds, 1)) != NULL) {
+        logUsage(command, elapsedSince(&start), &used, status);
+        free(command);
     }
 };
 
-/*************************************************************
-* main(): Function to call all functions an run the shell.   *
-*************************************************************/
-int main(int argc, char **argv) {
+/*********************************************************
+* testExpression(): Function to evaluate the expression  *
+*                   of test, made of numArgs arguments,  *
+*                   as sh does: a string alone, ! and    *
+*                   the unary file and string primaries  *
+*                   (-e -f -d -h -L -r -w -x -s -n -z),  *
+*                   and the binary string and integer    *
+*                   ones (= == != -eq -ne -lt -le -gt    *
+*                   -ge). Returns the exit value: 0 if   *
+*                   true, 1 if false, 2 on error.        *
+*********************************************************/
+int testExpression(char** args, int numArgs) {
 
-    // Set local main variables.
-    char* args[SIZE];   // array to store input arguments
-    char* input;        // store user input.
-    int isFore;         // flag to identify foreground or background process.
-    int key = 1;        // Loop key
- 
-    //set up the signal handler behavior. Code model taken from:
-    //https://www.gnu.org/software/libc/manual/html_node/Sigaction-Function-Example.html
-    // Make signals can be ignored.
-    action.sa_handler = SIG_IGN;
-    // Make no flags interrupt the shell execution.
-    action.sa_flags = 0;
-    // Make no signals interrupt the shell execution.
-    sigfillset(&(action.sa_mask));
-    sigaction(SIGINT, &action, NULL);
-    
-    // Main command loop.
-    do {
-        // The default action is to take all
-        // processes as foreground processes.
-        isFore = 1;
+    static char* binary[] = {"=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL};
+    struct stat info;
+    char* end;
+    long left, right;
+    int result;
+    int op;
 
-        // Print constant prompt.
-        printf(": ");
-        
-        // Clean prompt using fflush to eliminate garbage from buffer.
-        fflush(stdout);
-        
-        // Get user input.
-        input = read_input();
-        
-        // Tokenize Input.
-        tokenize(input, args, isFore);
-        
-    } while (key == 1); //Loop conditional.
-    
-    return 0; //End main.
+    // Is the middle one of three a binary primary?
+    for (op = 0; numArgs == 3 && binary[op] != NULL && strcmp(args[1], binary[op]) != 0; op++) {
+        continue;
+    }
+    if (numArgs == 0) {
+        return 1;
+    } else if (numArgs == 1) {
+        return args[0][0] == '\0';
+    } else if (numArgs == 3 && binary[op] != NULL) {
+        if (op <= 2) {
+            return (strcmp(args[0], args[2]) == 0) == (op == 2);
+        }
+        left = strtol(args[0], &end, 10);
+        if (args[0][0] == '\0' || *end != '\0') {
+            printf("test: %s: integer expression expected\n", args[0]);
+            return 2;
+        }
+        right = strtol(args[2], &end, 10);
+        if (args[2][0] == '\0' || *end != '\0') {
+            printf("test: %s: integer expression expected\n", args[2]);
+            return 2;
+        }
+        switch (op) {
+            case 3: return !(left == right);
+            case 4: return !(left != right);
+            case 5: return !(left < right);
+            case 6: return !(left <= right);
+            case 7: return !(left > right);
+            default: return !(left >= right);
+        }
+    } else if (strcmp(args[0], "!") == 0) {
+        result = testExpression(&args[1], numArgs - 1);
+        return result == 2 ? 2 : !result;
+    } else if (numArgs == 2 && args[0][0] == '-' && args[0][1] != '\0' && args[0][2] == '\0') {
+        switch (args[0][1]) {
+            case 'n': return args[1][0] == '\0';
+            case 'z': return args[1][0] != '\0';
+            case 'e': return stat(args[1], &info) != 0;
+            case 'f': return stat(args[1], &info) != 0 || !S_ISREG(info.st_mode);
+            case 'd': return stat(args[1], &info) != 0 || !S_ISDIR(info.st_mode);
+            case 's': return stat(args[1], &info) != 0 || info.st_size == 0;
+            case 'h':
+            case 'L': return lstat(args[1], &info) != 0 || !S_ISLNK(info.st_mode);
+            case 'r': return access(args[1], R_OK) != 0;
+            case 'w': return access(args[1], W_OK) != 0;
+            case 'x': return access(args[1], X_OK) != 0;
+        }
+    }
+    printf("test: %s: unexpected argument\n", numArgs == 2 ? args[0] : args[1]);
+    return 2;
 };
 
+/*********************************************************
+* statsCommand(): Function to run the stats built-in     *
+*                 command, like the stats script: stats  *
+*                 -rows prints the average and median of *
+*                 each line, stats -cols those of each   *
+*                 column (as many as the first line has  *
+*                 numbers), of the file given or else of *
+*                 the standard input. The average is     *
+*                 rounded half up, and the median is the *
+*                 upper middle number when there are two *
+*                 of them. The input is read in one go   *
+*                 (mapped when it's a file) and parsed   *
+*                 in one pass, and the medians are found *
+*                 with selectValue(), not by sorting.    *
+*                 Returns the exit value.                *
+*********************************************************/
+int statsCommand(char* args[SIZE], int in_descriptor, FILE* output) {
 
+    struct values row = {NULL, 0, 0, 0};
+    struct values* columns = NULL;
+    size_t numColumns = 0;
+    size_t size;
+    size_t i;
+    char* data;
+    char* cursor;
+    char* first;                // cursor on the first line.
+    char* end;
+    long long value;
+    int isMapped;
+    int isRows;
+    int exitValue = 0;
+    int fd = in_descriptor;
 
+    // Same checks, in the same order, as the script.
+    if (args[1] != NULL && args[2] != NULL && args[3] != NULL) {
+        fflush(stdout);
+        fprintf(stderr, "Usage: stats {-rows|-cols} [file]\n");
+        return 1;
+    }
+    if (args[1] != NULL && args[2] != NULL && (fd = open(args[2], O_RDONLY | O_CLOEXEC)) == -1) {
+        fflush(stdout);
+        fprintf(stderr, "stats: cannot read %s\n", args[2]);
+        return 1;
+    }
+    if (args[1] == NULL || (strncmp(args[1], "-r", 2) != 0 && strncmp(args[1], "-c", 2) != 0)) {
+        fflush(stdout);
+        fprintf(stderr, "Usage: stats {-rows|-cols} [file]\n");
+        if (fd != in_descriptor) {
+            close(fd);
+        }
+        return 1;
+    }
+    isRows = strncmp(args[1], "-r", 2) == 0;
+    data = readAll(fd, &size, &isMapped);
+    if (fd != in_descriptor) {
+        close(fd);
+    }
+    if (data == NULL) {
+        fflush(stdout);
+        fprintf(stderr, "stats: cannot read %s\n", args[2] != NULL ? args[2] : "the input");
+        return 1;
+    }
+    cursor = data;
+    end = data + size;
 
+    if (isRows) {
+        fprintf(output, "Average\tMedian\n");
+        while (cursor < end && exitValue == 0) {
+            row.count = 0;
+            row.sum = 0;
+            while (nextValue(&cursor, end, &value)) {
+                if (addValue(&row, value) == -1) {
+                    exitValue = 1;
+                }
+            }
+            ++cursor;   // past the newline.
+            if (row.count == 0) {
+                fprintf(output, "\t\n");
+            } else {
+                fprintf(output, "%lld\t%lld\n", (row.sum + (long long) row.count / 2) / (long long) row.count,
+                        selectValue(row.data, row.count, row.count / 2));
+            }
+        }
+    } else {
+        // The first line tells how many columns there are.
+        for (first = cursor; nextValue(&first, end, &value); ) {
+            ++numColumns;
+        }
+        columns = calloc(numColumns > 0 ? numColumns : 1, sizeof(struct values));
+        if (columns == NULL) {
+            exitValue = 1;
+        }
+        // Add every number to its column, line after line.
+        while (cursor < end && exitValue == 0) {
+            for (i = 0; nextValue(&cursor, end, &value); i++) {
+                if (i < numColumns && addValue(&columns[i], value) == -1) {
+                    exitValue = 1;
+                }
+            }
+            ++cursor;   // past the newline.
+        }
+        fprintf(output, "Averages:\n");
+        for (i = 0; exitValue == 0 && i < numColumns; i++) {
+            fprintf(output, "%lld\t", (columns[i].sum + (long long) columns[i].count / 2) / (long long) columns[i].count);
+        }
+        fprintf(output, "\nMedians:\n");
+        for (i = 0; exitValue == 0 && i < numColumns; i++) {
+            fprintf(output, "%lld\t", selectValue(columns[i].data, columns[i].count, columns[i].count / 2));
+        }
+        fprintf(output, "\n");
+        for (i = 0; i < numColumns && columns != NULL; i++) {
+            free(columns[i].data);
+        }
+        free(columns);
+    }
+    if (exitValue != 0) {
+        fflush(stdout);
+        fprintf(stderr, "stats: out of memory\n");
+    }
+    free(row.data);
+    if (isMapped) {
+        munmap(data, size);
+    } else {
+        free(data);
+    }
+    return exitValue;
+};
+
+/*********************************************************
+* nextValue(): Function to read the next number of the   *
+*              line at cursor into value, skipping words *
+*              that aren't numbers, and move the cursor  *
+*              past it. Returns 0, with the cursor at    *
+*              the newline (or the end), when the line   *
+*              has no more numbers.                      *
+*********************************************************/
+int nextValue(char** cursor, char* end, long long* value) {
+
+    char* read = *cursor;
+    int isNegative;
+
+    for (;;) {
+        while (read < end && (*read == ' ' || *read == '\t' || *read == '\r')) {
+            ++read;
+        }
+        if (read == end || *read == '\n') {
+            *cursor = read;
+            return 0;
+        }
+        isNegative = *read == '-';
+        if (*read == '-' || *read == '+') {
+            ++read;
+        }
+        if (read < end && *read >= '0' && *read <= '9') {
+            break;
+        }
+        while (read < end && *read != ' ' && *read != '\t' && *read != '\r' && *read != '\n') {
+            ++read;
+        }
+    }
+    *value = 0;
+    while (read < end && *read >= '0' && *read <= '9') {
+        *value = *value * 10 + (*read - '0');
+        ++read;
+    }
+    if (isNegative) {
+        *value = -*value;
+    }
+    // Whatever is left of the word isn't part of it.
+    while (read < end && *read != ' ' && *read != '\t' && *read != '\r' && *read != '\n') {
+        ++read;
+    }
+    *cursor = read;
+    return 1;
+};
+
+/*********************************************************
+* addValue(): Function to add value to the list, growing *
+*             it when it's full. Returns -1 if out of    *
+*             memory.                                    *
+*********************************************************/
+int addValue(struct values* list, long long value) {
+
+    long long* grown;
+
+    if (list->count == list->capacity) {
+        grown = realloc(list->data, (list->capacity == 0 ? 64 : list->capacity * 2) * sizeof(long long));
+        if (grown == NULL) {
+            return -1;
+        }
+        list->data = grown;
+        list->capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+    }
+    list->data[list->count] = value;
+    list->count++;
+    list->sum += value;
+    return 0;
+};
+
+/*********************************************************
+* selectValue(): Function to find the k-th smallest of   *
+*                the numValues values (from 0), as if    *
+*                they were sorted, in linear time on     *
+*                average: quickselect only partitions    *
+*                the side k is in, around the median of  *
+*                three. The values are reordered.        *
+*********************************************************/
+long long selectValue(long long* values, size_t numValues, size_t k) {
+
+    long left = 0;
+    long right = (long) numValues - 1;
+    long middle, i, j;
+    long long pivot, swap;
+
+    while (left < right) {
+        // Order the first, middle and last values, and take the
+        // middle one as the pivot.
+        middle = left + (right - left) / 2;
+        if (values[middle] < values[left]) {
+            swap = values[middle];
+            values[middle] = values[left];
+            values[left] = swap;
+        }
+        if (values[right] < values[left]) {
+            swap = values[right];
+            values[right] = values[left];
+            values[left] = swap;
+        }
+        if (values[right] < values[middle]) {
+            swap = values[right];
+            values[right] = values[middle];
+            values[middle] = swap;
+        }
+        pivot = values[middle];
+
+        // Smaller values to the left, bigger ones to the right.
+        i = left;
+        j = right;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                ++i;
+            }
+            while (values[j] > pivot) {
+                --j;
+            }
+            if (i <= j) {
+                swap = values[i];
+                values[i] = values[j];
+                values[j] = swap;
+                ++i;
+                --j;
+            }
+        }
+        // Go on with the side k is in, unless it's between them,
+        // where every value equals the pivot.
+        if ((long) k <= j) {
+            right = j;
+        } else if ((long) k >= i) {
+            left = i;
+        } else {
+            return values[k];
+        }
+    }
+    return values[k];
+};
+
+/*********************************************************
+* copyData(): Function to copy everything left to read   *
+*             from one descriptor to another. It tries   *
+*             copy_file_range(), which copies within the *
+*             kernel between files (or shares their      *
+*             blocks), then sendfile(), which needs an   *
+*             input it can map, and last read() and      *
+*             write() for pipes and terminals. Returns   *
+*             -1 on error, with errno set.               *
+*********************************************************/
+int copyData(int from, int to) {
+
+    char buffer[65536];
+    ssize_t numCopied;
+    ssize_t numWritten;
+    int method = 0;             // 0: copy_file_range(), 1: sendfile(), 2: read().
+    int i;
+
+    for (;;) {
+        if (method == 0) {
+            numCopied = copy_file_range(from, NULL, to, NULL, 1 << 30, 0);
+        } else if (method == 1) {
+            numCopied = sendfile(to, from, NULL, 1 << 30);
+        } else {
+            numCopied = read(from, buffer, sizeof(buffer));
+            for (i = 0; i < numCopied; i += numWritten) {
+                numWritten = write(to, buffer + i, numCopied - i);
+                if (numWritten == -1 && errno != EINTR) {
+                    return -1;
+                } else if (numWritten == -1) {
+                    numWritten = 0;
+                }
+            }
+        }
+        if (numCopied == 0) {
+            return 0;
+        }
+        // Whatever can't be done one way falls to the next one.
+        if (numCopied == -1 && method < 2 && (errno == EINVAL || errno == EXDEV || errno == ENOSYS
+                                              || errno == EBADF || errno == EOPNOTSUPP)) {
+            ++method;
+        } else if (numCopied == -1 && errno != EINTR) {
+            return -1;
+        }
+    }
+};
+
+/*********************************************************
+* spawnChild(): Function to start a child process with   *
+*               posix_spawn(), which doesn't copy the    *
+*               shell's memory like fork() does, so a    *
+*               command starts as fast however big the   *
+*               shell gets. The input/output redirection *
+*               is done by file actions: standard input  *
+*               comes from inPipe and standard output    *
+*               goes to outPipe when they are not -1     *
+*               (the pipes between the commands of a     *
+*               pipeline). The command is run from the   *
+*               path findCommand() gives, so PATH isn't  *
+*               searched again. At a terminal, the child *
+*               joins the process group group (0 starts  *
+*               a new one), which a foreground child     *
+*               hands the terminal to. A group of -1     *
+*               leaves it in the shell's group. stats,   *
+*               which has no binary, gets a child of the *
+*               shell instead (see forkStats()). Returns *
+*               the PID of the child, or -1 if it        *
+*               couldn't be started.                     *
+*********************************************************/
+pid_t spawnChild(char* args[SIZE], char* fileIn, char* fileOut, int inPipe, int outPipe, int isFore, pid_t group) {
+
+    int in_descriptor = -1;     // input file descriptor.
+    int out_descriptor = -1;    // output file descriptor.
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    sigset_t signals;
+    pid_t pid = -1;
+    int error;
+    char path[PATH_MAX];        // where the command is.
+    int isStats = strcmp(args[0], "stats") == 0;
+
+    if (!isStats && findCommand(args[0], path) == -1) {
+        printf("Error: command \"%s\" not found\n", args[0]);
+        flushOutput();
+        return -1;
+    }
+
+    // The shell opens the files itself, so it can tell which one
+    // failed. They are closed in the child on exec.
+    //handle input redirection
+    if (fileIn != NULL) {
+        // open input file and check for error.
+        in_descriptor = open(fileIn, O_RDONLY | O_CLOEXEC); //set file to be read.
+        if (in_descriptor == -1) { //check opening error.
+            printf("Error: cannot open %s for input\n", fileIn);
+            flushOutput();
+            return -1;
+        }
+    // If it's a background process, make sure it doesn't read
+    // from the terminal. Only the first command of a pipeline
+    // reads from it, the others read from their pipe.
+    } else if (isFore == 0 && inPipe == -1) {
+        // Standard input redirected from /dev/null if the user didn't
+        // specify some other file to take standard input from.
+        in_descriptor = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (in_descriptor == -1) {
+            perror("open");  //display error.
+            return -1;
+        }
+    }
+    //handle output redirection
+    if (fileOut != NULL) {
+        // open output file and check for error.
+        out_descriptor = open(fileOut, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0744);
+        if (out_descriptor == -1) {
+            printf("Error: cannot open %s for output\n", fileOut);
+            flushOutput();
+            if (in_descriptor != -1) {
+                close(in_descriptor);
+            }
+            return -1;
+        }
+    }
+    // stats reads from and writes to the same places a spawned
+    // command would.
+    if (isStats) {
+        pid = forkStats(args, in_descriptor != -1 ? in_descriptor : inPipe,
+                        out_descriptor != -1 ? out_descriptor : outPipe, isFore, group);
+        if (in_descriptor != -1) {
+            close(in_descriptor);
+        }
+        if (out_descriptor != -1) {
+            close(out_descriptor);
+        }
+        return pid;
+    }
+    // Give the terminal to the new group before the child runs,
+    // so it can't read from it first and get stopped.
+    posix_spawn_file_actions_init(&actions);
+    if (group == 0 && isFore == 1) {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, 0);
+    }
+    // Replace standard input and output in the child. A file
+    // takes precedence over a pipe, as it would in sh.
+    if (in_descriptor != -1) {
+        posix_spawn_file_actions_adddup2(&actions, in_descriptor, 0);
+    } else if (inPipe != -1) {
+        posix_spawn_file_actions_adddup2(&actions, inPipe, 0);
+    }
+    if (out_descriptor != -1) {
+        posix_spawn_file_actions_adddup2(&actions, out_descriptor, 1);
+    } else if (outPipe != -1) {
+        posix_spawn_file_actions_adddup2(&actions, outPipe, 1);
+    }
+    // If it's a foreground process, set the signal handler to
+    // default so the foreground commands can be interrupted. A
+    // background one keeps ignoring SIGINT like the shell, unless
+    // it has a process group of its own: the terminal only sends
+    // SIGINT to the foreground group, so it can be interrupted
+    // once fg brings it there. Such a child can also be stopped
+    // from the terminal, unlike the shell. No signal is blocked
+    // in the child either way.
+    posix_spawnattr_init(&attributes);
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    if (isFore == 1 || group != -1) {
+        sigaddset(&signals, SIGINT);
+    }
+    if (group != -1) {
+        sigaddset(&signals, SIGTSTP);
+        sigaddset(&signals, SIGTTIN);
+        sigaddset(&signals, SIGTTOU);
+        posix_spawnattr_setpgroup(&attributes, group);
+    }
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF
+                             | (group != -1 ? POSIX_SPAWN_SETPGROUP : 0));
+
+    // Whatever a script printed so far goes out before the command
+    // writes to the same output.
+    fflush(stdout);
+
+    //execute the command/arguments and check for error.
+    error = posix_spawn(&pid, path, &actions, &attributes, args, environ);
+
+    // The command may have moved since it was cached. Forget it
+    // and search PATH again.
+    if (error == ENOENT && strchr(args[0], '/') == NULL) {
+        forgetCommands(args[0]);
+        if (findCommand(args[0], path) == 0) {
+            error = posix_spawn(&pid, path, &actions, &attributes, args, environ);
+        }
+    }
+    if (error == ENOENT) {
+        printf("Error: command \"%s\" not found\n", args[0]);
+        flushOutput();
+    } else if (error != 0) {
+        printf("Error: cannot run \"%s\": %s\n", args[0], strerror(error));
+        flushOutput();
+    }
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    if (in_descriptor != -1) {
+        close(in_descriptor);
+    }
+    if (out_descriptor != -1) {
+        close(out_descriptor);
+    }
+    return error == 0 ? pid : -1;
+};
+
+/*********************************************************
+* forkStats(): Function to run stats in a child of the   *
+*              shell, for a pipeline or a background     *
+*              job, where the shell can't run it itself. *
+*              The child is set up like spawnChild()     *
+*              sets up a command: same process group,    *
+*              terminal and signals. It reads from       *
+*              in_descriptor and writes to               *
+*              out_descriptor, or to the shell's own     *
+*              input and output when they are -1.        *
+*              Returns the PID of the child, or -1 if it *
+*              couldn't be started.                      *
+*********************************************************/
+pid_t forkStats(char* args[SIZE], int in_descriptor, int out_descriptor, int isFore, pid_t group) {
+
+    sigset_t signals;
+    int exitValue;
+    pid_t pid;
+
+    // Don't print what the shell printed so far twice.
+    fflush(stdout);
+    pid = fork();
+    if (pid == -1) {
+        printf("Error: cannot run \"%s\": %s\n", args[0], strerror(errno));
+        flushOutput();
+        return -1;
+    }
+    if (pid == 0) {
+        // The terminal is taken while SIGTTOU is still ignored.
+        if (group != -1) {
+            setpgid(0, group);
+            if (group == 0 && isFore == 1) {
+                tcsetpgrp(0, getpgrp());
+            }
+            signal(SIGTSTP, SIG_DFL);
+            signal(SIGTTIN, SIG_DFL);
+            signal(SIGTTOU, SIG_DFL);
+        }
+        if (isFore == 1 || group != -1) {
+            signal(SIGINT, SIG_DFL);
+        }
+        sigemptyset(&signals);
+        sigprocmask(SIG_SETMASK, &signals, NULL);
+        if (in_descriptor != -1) {
+            dup2(in_descriptor, 0);
+        }
+        if (out_descriptor != -1) {
+            dup2(out_descriptor, 1);
+        }
+        exitValue = statsCommand(args, 0, stdout);
+        if (fflush(stdout) == EOF) {
+            exitValue = 1;
+        }
+        _exit(exitValue);
+    }
+    // Set the group from the shell too, so the next command of
+    // the pipeline can join it before the child has run.
+    if (group != -1) {
+        setpgid(pid, group == 0 ? pid : group);
+    }
+    return pid;
+};
+
+/*********************************************************
+* execute(): Function to execute the input commands and  *
+*            arguments. It also performs the piping      *
+*            process and handles of the input/output     *
+*            file redirection. Every command of a        *
+*            pipeline gets its own child, and they all   *
+*            run at the same time. The status of a       *
+*            foreground pipeline is the one of its last  *
+*            command. At a terminal, the pipeline gets a *
+*            process group of its own, and the terminal  *
+*            while it runs in the foreground.            *
+*********************************************************/
+void execute(char** cmds[SIZE], int numCmds, char* fileIn, char* fileOut, int isFore) {
+
+    pid_t pidArray[SIZE];       // store PIDs of the processes created.
+    pid_t pid = 0;              // store current PID.
+    struct job* job = NULL;
+    struct timespec start;      // when the pipeline was started.
+    struct rusage childUsage;
+    struct rusage pipelineUsage; // resources used by the commands done.
+    char* command;
+    char* group;                // cgroup the commands start in, or NULL.
+    pid_t pgid = interactive ? 0 : -1; // process group of the pipeline.
+    int pipeFds[2];             // pipe to the next command.
+    int inPipe = -1;            // read end of the pipe from the previous command.
+    int numStarted = 0;         // children started so far.
+    int childStatus;
+    int i;
+
+    memset(&pipelineUsage, 0, sizeof(pipelineUsage));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    group = startGroup(isFore);
+    for (i = 0; i < numCmds; i++) {
+        // Create the pipe to the next command, if any.
+        pipeFds[0] = pipeFds[1] = -1;
+        if (i < numCmds - 1 && pipe2(pipeFds, O_CLOEXEC) == -1) {
+            perror("pipe");
+            status = 256;   // exit value 1.
+            break;
+        }
+        // Start the child. It gets any needed input/output redirection
+        // before running exec() on the command given. The redirection
+        // symbol and redirection destination and/or source are NOT
+        // passed into the exec command. The pipes are close-on-exec,
+        // so the child only keeps the ends moved to its standard
+        // input and output.
+        pid = spawnChild(cmds[i], i == 0 ? fileIn : NULL, i == numCmds - 1 ? fileOut : NULL,
+                         inPipe, pipeFds[1], isFore, pgid);
+
+        // The parent keeps neither end: the previous read end now belongs
+        // to the child, and the write end of the new pipe too.
+        if (inPipe != -1) {
+            close(inPipe);
+        }
+        if (pipeFds[1] != -1) {
+            close(pipeFds[1]);
+        }
+        inPipe = pipeFds[0];
+
+        // A command that couldn't start fails with exit value 1,
+        // and the rest of the pipeline runs without it, as in sh.
+        if (pid < 0) {
+            if (i == numCmds - 1) {
+                status = 256;   // exit value 1.
+            }
+            continue;
+        }
+        // Save most recent pid in the array designated to
+        // keep the pid of all processes.
+        pidArray[numStarted] = pid;
+        numStarted++;
+        pidCounter++; // Increment pid counter.
+
+        // The first command started leads the process group.
+        if (pgid == 0) {
+            pgid = pid;
+        }
+    }
+    if (inPipe != -1) {
+        close(inPipe);
+    }
+    if (group != NULL) {
+        writeGroupFile(cgroupShell, "cgroup.procs", "0");
+    }
+
+    // Parent Process (shell): It runs continuously. Whenever a
+    // non-built in command is received, it starts a child.
+    for (i = 0; i < numStarted; i++) {
+        if (isFore == 1) {
+            // Wait for completion of foreground commands before
+            // prompting for the next command..
+            wait4(pidArray[i], &childStatus, WUNTRACED, &childUsage);
+
+            // A command stopped by a signal turns what is left of
+            // the pipeline into a job, to be resumed with fg or bg.
+            if (WIFSTOPPED(childStatus)) {
+                job = addJob(&pidArray[i], numStarted - i, cmds, numCmds);
+                if (job != NULL) {
+                    job->isStopped = 1;
+                    job->pgid = pgid > 0 ? pgid : 0;
+                    job->start = start;
+                    job->usage = pipelineUsage;
+                    job->cgroup = group;
+                    group = NULL;
+                    printf("[%i] Stopped\t%s\n", job->id, job->command);
+                }
+                break;
+            }
+            addUsage(&pipelineUsage, &childUsage);
+            if (pid > 0 && i == numStarted - 1) {
+                status = childStatus;
+            }
+        } else {
+            // Otherwise, it's a background process. So print the
+            // pid of the background process.
+            printf("background pid is %i\n", pidArray[i]);
+        }
+    }
+    // The shell takes the terminal back.
+    if (isFore == 1 && pgid > 0) {
+        tcsetpgrp(0, shellGroup);
+    }
+    // Keep track of the background ones in the job table.
+    if (isFore == 0 && numStarted > 0) {
+        job = addJob(pidArray, numStarted, cmds, numCmds);
+        if (job != NULL) {
+            job->pgid = pgid > 0 ? pgid : 0;
+            job->start = start;
+            job->cgroup = group;
+            job->ownsGroup = runGroup == NULL;
+            group = NULL;
+        }
+
+    // Count what a foreground pipeline used for time, and log it
+    // once it is done. A stopped one is logged when its job is.
+    } else if (isFore == 1 && numStarted > 0) {
+        addUsage(&usage, &pipelineUsage);
+        if (logFile != NULL && job == NULL && (command = joinCommands(cmds, numCmds)) != NULL) {
+            logUsage(command, elapsedSince(&start), &pipelineUsage, status);
+            free(command);
+        }
+    }
+    // A group made for a job that didn't start goes away.
+    if (group != NULL) {
+        if (runGroup == NULL) {
+            rmdir(group);
+        }
+        free(group);
+    }
+    // Call function to check for finished background processes.
+    finishProcesses();
+};
+
+/****************************************************************
+* read_input(): Function to read user's input. At a terminal,   *
+*               the background jobs are reported as soon as     *
+*               they finish, while waiting for the line. Every  *
+*               line goes into the same buffer, which getline() *
+*               only grows when a line doesn't fit. The lines   *
+*               of a script are copied into it from the script  *
+*               in memory. Returns NULL at the end of the       *
+*               input.                                          *
+****************************************************************/
+char *read_input(void) {
+    struct pollfd fds[2] = {{0, POLLIN, 0}, {sigchldFd, POLLIN, 0}};
+    char* end;
+    char* grown;
+    size_t length;
+
+    if (script != NULL) {
+        if (scriptOffset >= scriptSize) {
+            return NULL;
+        }
+        end = memchr(script + scriptOffset, '\n', scriptSize - scriptOffset);
+        length = (end != NULL ? (size_t) (end - script) : scriptSize) - scriptOffset;
+        if (length + 1 > lineSize) {
+            grown = realloc(lineBuffer, length + 1);
+            if (grown == NULL) {
+                perror("realloc");
+                return NULL;
+            }
+            lineBuffer = grown;
+            lineSize = length + 1;
+        }
+        memcpy(lineBuffer, script + scriptOffset, length);
+        lineBuffer[length] = '\0';
+        scriptOffset += length + 1;
+        return lineBuffer;
+    }
+    while (interactive && poll(fds, 2, -1) > 0 && fds[0].revents == 0) {
+        // Reprint the prompt after the notices.
+        if (finishProcesses() > 0) {
+            printf(": ");
+            flushOutput();
+        }
+    }
+    if (getline(&lineBuffer, &lineSize, stdin) == -1) {
+        return NULL;
+    }
+    return lineBuffer; // Return processed input.
+};
+
+/****************************************************************
+* loadScript(): Function to get the script file at path into    *
+*               memory (see readAll()). Returns -1 if it can't  *
+*               be read.                                        *
+****************************************************************/
+int loadScript(char* path) {
+
+    int isMapped;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd == -1) {
+        return -1;
+    }
+    script = readAll(fd, &scriptSize, &isMapped);
+    close(fd);
+    return script == NULL ? -1 : 0;
+};
+
+/****************************************************************
+* readAll(): Function to get all that is left to read from fd   *
+*            into memory. A regular file read from its start is *
+*            mapped whole, so it is read straight from the page *
+*            cache (isMapped is set, and it's released with     *
+*            munmap()). Anything else (a pipe, a device) is     *
+*            read to the end with large reads into a buffer to  *
+*            be freed. Returns the data, with its size in size, *
+*            or NULL if it can't be read.                       *
+****************************************************************/
+char *readAll(int fd, size_t* size, int* isMapped) {
+
+    struct stat info;
+    char* data = NULL;
+    char* grown;
+    size_t capacity = 0;
+    ssize_t numRead;
+
+    *size = 0;
+    *isMapped = 0;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0 && lseek(fd, 0, SEEK_CUR) == 0) {
+        data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            *size = info.st_size;
+            *isMapped = 1;
+            return data;
+        }
+        data = NULL;
+    }
+    for (;;) {
+        if (*size == capacity) {
+            capacity = capacity == 0 ? 65536 : capacity * 2;
+            grown = realloc(data, capacity);
+            if (grown == NULL) {
+                numRead = -1;
+                break;
+            }
+            data = grown;
+        }
+        numRead = read(fd, data + *size, capacity - *size);
+        if (numRead > 0) {
+            *size += numRead;
+        } else if (numRead == 0 || errno != EINTR) {
+            break;
+        }
+    }
+    if (numRead == -1) {
+        free(data);
+        return NULL;
+    }
+    return data;
+};
+
+/****************************************************************
+* flushOutput(): Function to write out what the shell printed.  *
+*                A script's output stays in the stdout buffer   *
+*                instead, and goes out in one write just before *
+*                a command starts or the shell waits for one,   *
+*                or when the shell exits.                       *
+****************************************************************/
+void flushOutput(void) {
+
+    if (script == NULL) {
+        fflush(stdout);
+    }
+};
+
+/****************************************************************
+* finishProcesses(): Function to check for finished background  *
+*                    processes and print out their PIDs. The    *
+*                    children are only waited for when SIGCHLD  *
+*                    says one of them changed state. Returns    *
+*                    how many changes were printed: a process   *
+*                    resumed isn't.                             *
+****************************************************************/
+int finishProcesses(void) {
+
+    struct signalfd_siginfo info;
+    struct job* job;
+    struct rusage childUsage;
+    int childStatus;
+    int numPrinted = numNotices;
+    pid_t pid;
+
+    // Nothing to do if no SIGCHLD came since last time.
+    if (read(sigchldFd, &info, sizeof(info)) != sizeof(info)) {
+        return 0;
+    }
+    while (read(sigchldFd, &info, sizeof(info)) == sizeof(info)) {
+        continue;
+    }
+    // Get pid of waiting/zombie processes.
+    pid = wait4(-1, &childStatus, WNOHANG | WUNTRACED | WCONTINUED, &childUsage);
+
+    // Display the pid of the background processes.
+    while (pid > 0) {
+        job = updateJob(pid, childStatus, &childUsage, 1);
+        if (job != NULL && job->numLeft == 0) {
+            removeJob(job);
+        }
+        pid = wait4(-1, &childStatus, WNOHANG | WUNTRACED | WCONTINUED, &childUsage);
+    }
+    flushOutput();
+    return numNotices - numPrinted;
+};
+
+/*********************************************************
+* addJob(): Function to add a pipeline of numPids        *
+*           processes to the job table, with the command *
+*           line made of its numCmds commands. Returns   *
+*           the new job, or NULL if out of memory.       *
+*********************************************************/
+struct job *addJob(pid_t pids[SIZE], int numPids, char** cmds[SIZE], int numCmds) {
+
+    struct job* job = calloc(1, sizeof(struct job));
+    struct jobProcess* process;
+    int i;
+
+    if (job == NULL) {
+        return NULL;
+    }
+    job->command = joinCommands(cmds, numCmds);
+    job->pids = malloc(numPids * sizeof(pid_t));
+    if (job->command == NULL || job->pids == NULL) {
+        free(job->command);
+        free(job->pids);
+        free(job);
+        return NULL;
+    }
+
+    // Register every process so it can be found by PID.
+    for (i = 0; i < numPids; i++) {
+        job->pids[i] = pids[i];
+        process = malloc(sizeof(struct jobProcess));
+        if (process != NULL) {
+            process->pid = pids[i];
+            process->job = job;
+            process->next = processTable[pids[i] % PID_HASH_SIZE];
+            processTable[pids[i] % PID_HASH_SIZE] = process;
+        }
+    }
+    job->numPids = numPids;
+    job->numLeft = numPids;
+
+    // Number the job after the last one, starting over at 1 once
+    // the table is empty.
+    job->id = lastJob != NULL ? lastJob->id + 1 : 1;
+    job->prev = lastJob;
+    if (lastJob != NULL) {
+        lastJob->next = job;
+    } else {
+        firstJob = job;
+    }
+    lastJob = job;
+    return job;
+};
+
+/*********************************************************
+* joinCommands(): Function to join the numCmds commands  *
+*                 of a pipeline back into one line.      *
+*                 Returns it, to be freed, or NULL if    *
+*                 out of memory.                         *
+*********************************************************/
+char *joinCommands(char** cmds[SIZE], int numCmds) {
+
+    char* command;
+    size_t length = 0;
+    int i, j;
+
+    for (i = 0; i < numCmds; i++) {
+        for (j = 0; cmds[i][j] != NULL; j++) {
+            length += strlen(cmds[i][j]) + 1;
+        }
+        length += 2;
+    }
+    command = malloc(length + 1);
+    if (command == NULL) {
+        return NULL;
+    }
+    command[0] = '\0';
+    for (i = 0; i < numCmds; i++) {
+        if (i > 0) {
+            strcat(command, "| ");
+        }
+        for (j = 0; cmds[i][j] != NULL; j++) {
+            strcat(command, cmds[i][j]);
+            strcat(command, " ");
+        }
+    }
+    command[strlen(command) - 1] = '\0';
+    return command;
+};
+
+/*********************************************************
+* removeJob(): Function to take a job whose processes    *
+*              are all done out of the job table.        *
+*********************************************************/
+void removeJob(struct job* job) {
+
+    if (job->prev != NULL) {
+        job->prev->next = job->next;
+    } else {
+        firstJob = job->next;
+    }
+    if (job->next != NULL) {
+        job->next->prev = job->prev;
+    } else {
+        lastJob = job->prev;
+    }
+    if (job->ownsGroup) {
+        rmdir(job->cgroup);
+    }
+    free(job->cgroup);
+    free(job->command);
+    free(job->pids);
+    free(job);
+};
+
+/*********************************************************
+* findJob(): Function to find the job given to the       *
+*            built-in command name, as "N" or "%N", or   *
+*            the last job when spec is NULL. Prints an   *
+*            error and returns NULL if there is none.    *
+*********************************************************/
+struct job *findJob(char* spec, char* name) {
+
+    struct job* job;
+    int id;
+
+    if (spec == NULL) {
+        if (lastJob == NULL) {
+            printf("%s: no current job\n", name);
+        }
+        return lastJob;
+    }
+    id = atoi(spec[0] == '%' ? spec + 1 : spec);
+    for (job = firstJob; job != NULL && job->id != id; job = job->next) {
+        continue;
+    }
+    if (job == NULL) {
+        printf("%s: %s: no such job\n", name, spec);
+    }
+    return job;
+};
+
+/*********************************************************
+* updateJob(): Function to record that the process pid   *
+*              changed state, and print it out if notify *
+*              is set. The resources it used once done   *
+*              (childUsage) add up to its job's, logged  *
+*              with -t when the job is done. Returns its *
+*              job, or NULL if it isn't in the job       *
+*              table. The job is left in the table even  *
+*              when it is done.                          *
+*********************************************************/
+struct job *updateJob(pid_t pid, int childStatus, struct rusage* childUsage, int notify) {
+
+    struct jobProcess** link = &processTable[pid % PID_HASH_SIZE];
+    struct jobProcess* process;
+    struct job* job;
+    int i;
+
+    while (*link != NULL && (*link)->pid != pid) {
+        link = &(*link)->next;
+    }
+    if (*link == NULL) {
+        return NULL;
+    }
+    job = (*link)->job;
+
+    if (WIFSTOPPED(childStatus)) {
+        if (!job->isStopped && notify) {
+            printf("[%i] Stopped\t%s\n", job->id, job->command);
+            ++numNotices;
+        }
+        job->isStopped = 1;
+    } else if (WIFCONTINUED(childStatus)) {
+        job->isStopped = 0;
+    } else {
+        // The process is done: forget it.
+        process = *link;
+        *link = process->next;
+        free(process);
+        for (i = 0; i < job->numPids; i++) {
+            if (job->pids[i] == pid) {
+                job->pids[i] = 0;
+                if (i == job->numPids - 1) {
+                    job->lastStatus = childStatus;
+                }
+            }
+        }
+        job->numLeft--;
+        addUsage(&job->usage, childUsage);
+        if (notify) {
+            printf("background pid %i is done: ", pid);
+            printStatus(childStatus);
+            ++numNotices;
+        }
+        if (job->numLeft == 0 && job->cgroup != NULL && notify) {
+            printf("[%i] Done\t%s  [%s: ", job->id, job->command, strrchr(job->cgroup, '/') + 1);
+            printGroupUsage(job->cgroup);
+            printf("]\n");
+        }
+        if (job->numLeft == 0 && logFile != NULL) {
+            logUsage(job->command, elapsedSince(&job->start), &job->usage, job->lastStatus);
+        }
+    }
+    return job;
+};
+
+/*********************************************************
+* continueJob(): Function to resume a stopped job.       *
+*********************************************************/
+void continueJob(struct job* job) {
 
+    int i;
+
+    if (job->pgid > 0) {
+        kill(-job->pgid, SIGCONT);
+    }
+    for (i = 0; i < job->numPids && job->pgid == 0; i++) {
+        if (job->pids[i] != 0) {
+            kill(job->pids[i], SIGCONT);
+        }
+    }
+    job->isStopped = 0;
+};
+
+/*********************************************************
+* waitJob(): Function to wait until the job is done, or  *
+*            stopped. Once it is done, its status        *
+*            becomes the status of the shell and it      *
+*            leaves the job table.                       *
+*********************************************************/
+void waitJob(struct job* job, int notify) {
+
+    struct rusage childUsage;
+    int childStatus;
+    int i;
+
+    // Don't hold back what a script printed while waiting.
+    fflush(stdout);
+    for (i = 0; i < job->numPids && !job->isStopped; i++) {
+        if (job->pids[i] != 0 && wait4(job->pids[i], &childStatus, WUNTRACED, &childUsage) > 0) {
+            updateJob(job->pids[i], childStatus, &childUsage, notify);
+            if (!WIFSTOPPED(childStatus)) {
+                addUsage(&usage, &childUsage);
+            }
+        }
+    }
+    if (job->isStopped) {
+        printf("[%i] Stopped\t%s\n", job->id, job->command);
+    } else if (job->numLeft == 0) {
+        status = job->lastStatus;
+        removeJob(job);
+    }
+};
+
+/*********************************************************
+* jobCommands(): Function to run the job built-in        *
+*                commands: jobs lists the jobs, wait [N] *
+*                waits for job N or for all of them, fg  *
+*                [N] resumes job N (the last one by      *
+*                default) in the foreground and waits    *
+*                for it, and bg [N] resumes a stopped    *
+*                job in the background.                  *
+*********************************************************/
+void jobCommands(char* args[SIZE]) {
+
+    struct job* job;
+    struct job* next;
+
+    // Report what changed first, so the list is current.
+    finishProcesses();
+
+    if (strcmp(args[0], "jobs") == 0) {
+        for (job = firstJob; job != NULL; job = job->next) {
+            printf("[%i] %-8s %s", job->id, job->isStopped ? "Stopped" : "Running", job->command);
+            if (job->cgroup != NULL) {
+                printf("  [%s: ", strrchr(job->cgroup, '/') + 1);
+                printGroupUsage(job->cgroup);
+                printf("]");
+            }
+            printf("\n");
+        }
+    } else if (strcmp(args[0], "wait") == 0) {
+        if (args[1] == NULL) {
+            // A stopped job would never finish: skip it.
+            for (job = firstJob; job != NULL; job = next) {
+                next = job->next;
+                if (!job->isStopped) {
+                    waitJob(job, 1);
+                }
+            }
+        } else if ((job = findJob(args[1], "wait")) != NULL) {
+            waitJob(job, 1);
+        }
+    } else if (strcmp(args[0], "fg") == 0) {
+        if ((job = findJob(args[1], "fg")) != NULL) {
+            printf("%s\n", job->command);
+            flushOutput();
+            // The job gets the terminal while in the foreground.
+            if (job->pgid > 0) {
+                tcsetpgrp(0, job->pgid);
+            }
+            if (job->isStopped) {
+                continueJob(job);
+            }
+            waitJob(job, 0);
+            if (shellGroup > 0) {
+                tcsetpgrp(0, shellGroup);
+            }
+        }
+    } else if ((job = findJob(args[1], "bg")) != NULL) {
+        if (!job->isStopped) {
+            printf("bg: job %i already in background\n", job->id);
+        } else {
+            continueJob(job);
+            printf("[%i] %s &\n", job->id, job->command);
+        }
+    }
+    flushOutput();
+};
+
+/*********************************************************
+* parallelArgs(): Function to build the arguments of a   *
+*                 parallel job in jobArgs: the command   *
+*                 and arguments from args[first] up to   *
+*                 args[last], with arg in place of each  *
+*                 {} or else added at the end.           *
+*********************************************************/
+void parallelArgs(char* args[SIZE], int first, int last, char* arg, char* jobArgs[SIZE]) {
+
+    int position = 0;
+    int isReplaced = 0;
+    int i;
+
+    for (i = first; i < last; i++) {
+        if (strcmp(args[i], "{}") == 0) {
+            jobArgs[position] = arg;
+            isReplaced = 1;
+        } else {
+            jobArgs[position] = args[i];
+        }
+        ++position;
+    }
+    if (!isReplaced) {
+        jobArgs[position] = arg;
+        ++position;
+    }
+    jobArgs[position] = NULL;
+};
+
+/*********************************************************
+* parallelCommand(): Function to run the parallel        *
+*                    built-in command. The command runs  *
+*                    once for each argument after :::,   *
+*                    with at most N jobs (-j N, one per  *
+*                    CPU by default) at the same time:   *
+*                    as soon as one is done, the next    *
+*                    one starts in its slot. All jobs    *
+*                    share the files given with < and >  *
+*                    (/dev/null for the input by         *
+*                    default). The failed ones are       *
+*                    printed out when they are done,     *
+*                    and a summary at the end. The       *
+*                    status is exit value 1 if any of    *
+*                    them failed.                        *
+*********************************************************/
+void parallelCommand(char* args[SIZE], char* fileIn, char* fileOut) {
+
+    char* jobArgs[SIZE];        // arguments of the job being started.
+    char** jobCmds[SIZE];       // the job as a pipeline of one command.
+    char* command;
+    pid_t* running;             // PID of the job in each slot, 0 if free.
+    int* jobOf;                 // argument of the job in each slot.
+    struct timespec* started;   // when the job in each slot started.
+    struct timespec start;
+    struct rusage childUsage;
+    struct rusage total;        // resources used by all the jobs.
+    struct job* job;
+    char* group;                // cgroup the jobs start in, or NULL.
+    pid_t pid;
+    long maxJobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int first = 1;              // command of the jobs.
+    int last;                   // the ::: after its arguments.
+    int numArgs;
+    int next = 0;               // next argument to start a job for.
+    int numRunning = 0;
+    int numFailed = 0;
+    int isInterrupted = 0;
+    int in_descriptor, out_descriptor = -1;
+    int childStatus;
+    int slot;
+
+    // Read -j N, or -jN.
+    if (args[1] != NULL && strncmp(args[1], "-j", 2) == 0) {
+        if (args[1][2] != '\0') {
+            maxJobs = atol(args[1] + 2);
+            first = 2;
+        } else {
+            maxJobs = args[2] != NULL ? atol(args[2]) : 0;
+            first = 3;
+        }
+    }
+    for (last = first; args[last] != NULL && strcmp(args[last], ":::") != 0; last++) {
+        continue;
+    }
+    if (maxJobs < 1 || last == first || args[last] == NULL) {
+        printf("Usage: parallel [-j N] command [args] ::: args\n");
+        flushOutput();
+        status = 256;   // exit value 1.
+        return;
+    }
+    for (numArgs = 0; args[last + 1 + numArgs] != NULL; numArgs++) {
+        continue;
+    }
+    if (maxJobs > numArgs) {
+        maxJobs = numArgs > 0 ? numArgs : 1;
+    }
+
+    // Open the files once for all the jobs.
+    in_descriptor = open(fileIn != NULL ? fileIn : "/dev/null", O_RDONLY | O_CLOEXEC);
+    if (in_descriptor == -1) {
+        printf("Error: cannot open %s for input\n", fileIn != NULL ? fileIn : "/dev/null");
+        flushOutput();
+        status = 256;   // exit value 1.
+        return;
+    }
+    if (fileOut != NULL) {
+        out_descriptor = open(fileOut, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0744);
+        if (out_descriptor == -1) {
+            printf("Error: cannot open %s for output\n", fileOut);
+            flushOutput();
+            close(in_descriptor);
+            status = 256;   // exit value 1.
+            return;
+        }
+    }
+    running = calloc(maxJobs, sizeof(pid_t));
+    jobOf = calloc(maxJobs, sizeof(int));
+    started = calloc(maxJobs, sizeof(struct timespec));
+    if (running == NULL || jobOf == NULL || started == NULL) {
+        perror("calloc");
+        next = numArgs;
+        ++numFailed;
+    }
+    jobCmds[0] = jobArgs;
+    memset(&total, 0, sizeof(total));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (next < numArgs || numRunning > 0) {
+        // Start jobs in the free slots. One that can't start is
+        // failed right away.
+        while (next < numArgs && numRunning < maxJobs && !isInterrupted) {
+            for (slot = 0; running[slot] != 0; slot++) {
+                continue;
+            }
+            parallelArgs(args, first, last, args[last + 1 + next], jobArgs);
+            group = startGroup(1);
+            pid = spawnChild(jobArgs, NULL, NULL, in_descriptor, out_descriptor, 1, -1);
+            if (group != NULL) {
+                writeGroupFile(cgroupShell, "cgroup.procs", "0");
+                free(group);
+            }
+            if (pid < 0) {
+                ++numFailed;
+            } else {
+                running[slot] = pid;
+                jobOf[slot] = next;
+                clock_gettime(CLOCK_MONOTONIC, &started[slot]);
+                ++numRunning;
+                pidCounter++;
+            }
+            ++next;
+        }
+        if (numRunning == 0) {
+            break;
+        }
+        // Wait for whichever child is done first. It may be one of
+        // the background jobs instead.
+        pid = wait4(-1, &childStatus, 0, &childUsage);
+        if (pid == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("wait4");
+            break;
+        }
+        for (slot = 0; slot < maxJobs && running[slot] != pid; slot++) {
+            continue;
+        }
+        if (slot == maxJobs) {
+            job = updateJob(pid, childStatus, &childUsage, 1);
+            if (job != NULL && job->numLeft == 0) {
+                removeJob(job);
+            }
+            continue;
+        }
+        running[slot] = 0;
+        --numRunning;
+        addUsage(&total, &childUsage);
+
+        // Start no more jobs once interrupted, like any command.
+        if (WIFSIGNALED(childStatus) && WTERMSIG(childStatus) == SIGINT) {
+            isInterrupted = 1;
+        }
+        if (childStatus != 0 || logFile != NULL) {
+            parallelArgs(args, first, last, args[last + 1 + jobOf[slot]], jobArgs);
+            command = joinCommands(jobCmds, 1);
+            if (childStatus != 0) {
+                ++numFailed;
+                printf("parallel: %s: ", command != NULL ? command : jobArgs[0]);
+                printStatus(childStatus);
+                flushOutput();
+            }
+            if (logFile != NULL && command != NULL) {
+                logUsage(command, elapsedSince(&started[slot]), &childUsage, childStatus);
+            }
+            free(command);
+        }
+    }
+    printf("parallel: %i jobs, %i failed, %.3fs real, %ld.%03lds user, %ld.%03lds sys\n",
+           next, numFailed, elapsedSince(&start),
+           (long) total.ru_utime.tv_sec, (long) total.ru_utime.tv_usec / 1000,
+           (long) total.ru_stime.tv_sec, (long) total.ru_stime.tv_usec / 1000);
+    flushOutput();
+    addUsage(&usage, &total);
+    status = numFailed > 0 ? 256 : 0;   // exit value 1 if any failed.
+
+    free(running);
+    free(jobOf);
+    free(started);
+    close(in_descriptor);
+    if (out_descriptor != -1) {
+        close(out_descriptor);
+    }
+};
+
+/*********************************************************
+* setupCgroups(): Function to set up the cgroup v2 tree  *
+*                 of the shell the first time it's       *
+*                 needed: its top group is made in the   *
+*                 group the shell started in, and the    *
+*                 shell moves to "shell" in it, since    *
+*                 only a group without processes can     *
+*                 hand controllers down. The cpu, memory *
+*                 and io controllers are then enabled    *
+*                 for the groups of the jobs, those that *
+*                 can be (not held by cgroup v1, and     *
+*                 delegated to the user). Returns -1 if  *
+*                 cgroup v2 can't be used.               *
+*********************************************************/
+int setupCgroups(void) {
+
+    static char* controllers[] = {"+cpu", "+memory", "+io", NULL};
+    char line[PATH_MAX];
+    char path[PATH_MAX] = "";
+    char* mount;
+    FILE* file;
+    int i;
+
+    if (cgroupTop != NULL) {
+        return 0;
+    }
+    // cgroup v2 is mounted at /sys/fs/cgroup, or at "unified" in it
+    // next to cgroup v1.
+    mount = access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0 ? "/sys/fs/cgroup" : "/sys/fs/cgroup/unified";
+
+    // The group of the shell is on the "0::" line.
+    file = fopen("/proc/self/cgroup", "re");
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            if (snprintf(path, sizeof(path), "%s%s", mount, strcmp(line + 3, "/") == 0 ? "" : line + 3)
+                >= (int) sizeof(path)) {
+                path[0] = '\0';
+            }
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (path[0] == '\0' || readGroupFile(path, "cgroup.controllers", line, sizeof(line)) == -1) {
+        printf("cgroup: cgroup v2 is not available\n");
+        flushOutput();
+        return -1;
+    }
+    // The groups of the shell are made deeper, and must fit too.
+    if (snprintf(line, sizeof(line), "%s/smallsh-%i/shell", path, getpid()) >= (int) sizeof(line)) {
+        printf("cgroup: %s: %s\n", path, strerror(ENAMETOOLONG));
+        flushOutput();
+        return -1;
+    }
+    cgroupBase = strdup(path);
+    cgroupShell = strdup(line);
+    *strrchr(line, '/') = '\0';
+    cgroupTop = strdup(line);
+    if ((mkdir(cgroupTop, 0755) == -1 && errno != EEXIST) || (mkdir(cgroupShell, 0755) == -1 && errno != EEXIST)
+        || writeGroupFile(cgroupShell, "cgroup.procs", "0") == -1) {
+        printf("cgroup: %s: %s\n", cgroupTop, strerror(errno));
+        flushOutput();
+        rmdir(cgroupShell);
+        rmdir(cgroupTop);
+        free(cgroupBase);
+        free(cgroupTop);
+        free(cgroupShell);
+        cgroupBase = cgroupTop = cgroupShell = NULL;
+        return -1;
+    }
+    for (i = 0; controllers[i] != NULL; i++) {
+        writeGroupFile(cgroupBase, "cgroup.subtree_control", controllers[i]);
+        writeGroupFile(cgroupTop, "cgroup.subtree_control", controllers[i]);
+    }
+    return 0;
+};
+
+/*********************************************************
+* removeCgroups(): Function to move the shell back to    *
+*                  the group it started in and remove    *
+*                  the groups it made, when it exits.    *
+*                  Those still holding a process stay.   *
+*********************************************************/
+void removeCgroups(void) {
+
+    char path[PATH_MAX];
+    struct dirent* entry;
+    DIR* dir;
+
+    if (cgroupTop == NULL) {
+        return;
+    }
+    writeGroupFile(cgroupBase, "cgroup.procs", "0");
+    dir = opendir(cgroupTop);
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_DIR && entry->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", cgroupTop, entry->d_name);
+            rmdir(path);
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    rmdir(cgroupTop);
+};
+
+/*********************************************************
+* groupPath(): Function to get the directory of the      *
+*              group name, made if it isn't there yet.   *
+*              Returns it, to be freed, or NULL if it    *
+*              can't be made.                            *
+*********************************************************/
+char *groupPath(char* name) {
+
+    char* dir = malloc(strlen(cgroupTop) + strlen(name) + 2);
+
+    if (dir == NULL) {
+        return NULL;
+    }
+    sprintf(dir, "%s/%s", cgroupTop, name);
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        printf("cgroup: %s: %s\n", name, strerror(errno));
+        flushOutput();
+        free(dir);
+        return NULL;
+    }
+    return dir;
+};
+
+/*********************************************************
+* writeGroupFile(): Function to write value to the file  *
+*                   of the group at dir. Returns -1 on   *
+*                   error, with errno set.               *
+*********************************************************/
+int writeGroupFile(char* dir, char* file, char* value) {
+
+    char path[PATH_MAX];
+    ssize_t numWritten;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    numWritten = write(fd, value, strlen(value));
+    close(fd);
+    return numWritten == -1 ? -1 : 0;
+};
+
+/*********************************************************
+* readGroupFile(): Function to read the file of the      *
+*                  group at dir into text, ending it     *
+*                  with NUL. Returns -1 if it can't be   *
+*                  read.                                 *
+*********************************************************/
+int readGroupFile(char* dir, char* file, char* text, size_t size) {
+
+    char path[PATH_MAX];
+    ssize_t numRead;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    numRead = read(fd, text, size - 1);
+    close(fd);
+    if (numRead == -1) {
+        return -1;
+    }
+    text[numRead] = '\0';
+    return 0;
+};
+
+/*********************************************************
+* configureGroup(): Function to apply the settings to    *
+*                   the group at dir. Each one is        *
+*                   file=value, for instance             *
+*                   cpu.weight=20, memory.max=512M or    *
+*                   "io.max=8:0 wbps=1048576". Returns   *
+*                   -1 if one of them failed.            *
+*********************************************************/
+int configureGroup(char* dir, char** settings) {
+
+    char file[NAME_MAX + 1];
+    char* value;
+    int result = 0;
+    int i;
+
+    for (i = 0; settings[i] != NULL; i++) {
+        value = strchr(settings[i], '=');
+        if (value == NULL || value == settings[i] || value - settings[i] > NAME_MAX
+            || memchr(settings[i], '/', value - settings[i]) != NULL) {
+            printf("cgroup: %s: expected file=value\n", settings[i]);
+            result = -1;
+            continue;
+        }
+        snprintf(file, sizeof(file), "%.*s", (int) (value - settings[i]), settings[i]);
+        if (writeGroupFile(dir, file, value + 1) == -1) {
+            printf("cgroup: %s: %s\n", settings[i],
+                   errno == ENOENT ? "no such setting (is its controller enabled?)" : strerror(errno));
+            result = -1;
+        }
+    }
+    flushOutput();
+    return result;
+};
+
+/*********************************************************
+* groupValue(): Function to read a number from the file  *
+*               of the group at dir: the whole file when *
+*               key is NULL, or else the sum of the      *
+*               numbers after key (io.stat has one line  *
+*               per device). Returns -1 if it can't be   *
+*               read.                                    *
+*********************************************************/
+long long groupValue(char* dir, char* file, char* key) {
+
+    char text[4096];
+    char* found;
+    long long value = 0;
+
+    if (readGroupFile(dir, file, text, sizeof(text)) == -1) {
+        return -1;
+    }
+    if (key == NULL) {
+        return strtoll(text, NULL, 10);
+    }
+    for (found = strstr(text, key); found != NULL; found = strstr(found, key)) {
+        found += strlen(key);
+        value += strtoll(found, NULL, 10);
+    }
+    return value;
+};
+
+/*********************************************************
+* printGroupUsage(): Function to print out what the      *
+*                    processes in the group at dir have  *
+*                    used: CPU time, and the memory and  *
+*                    I/O when their controllers are on.  *
+*********************************************************/
+void printGroupUsage(char* dir) {
+
+    long long cpu = groupValue(dir, "cpu.stat", "usage_usec ");
+    long long memory = groupValue(dir, "memory.current", NULL);
+    long long bytesRead = groupValue(dir, "io.stat", "rbytes=");
+    long long bytesWritten = groupValue(dir, "io.stat", "wbytes=");
+
+    printf("cpu %.3fs", cpu > 0 ? cpu / 1e6 : 0.0);
+    if (memory != -1) {
+        printf(", mem %lldK", memory / 1024);
+    }
+    if (bytesRead != -1) {
+        printf(", io %lldK read %lldK written", bytesRead / 1024, bytesWritten / 1024);
+    }
+};
+
+/*********************************************************
+* startGroup(): Function to move the shell into the      *
+*               group the commands it starts next go to, *
+*               so they are in it from the start: the    *
+*               one given to cgroup -e, or a new one for *
+*               a background job with cgroup -j. The     *
+*               shell moves back to its own group once   *
+*               they are started. Returns the group, to  *
+*               be freed, or NULL if there is none.      *
+*********************************************************/
+char *startGroup(int isFore) {
+
+    char name[32];
+    char* dir = NULL;
+
+    if (runGroup != NULL) {
+        dir = groupPath(runGroup);
+    } else if (isFore == 0 && jobSettings != NULL) {
+        // Named after the job about to be added.
+        snprintf(name, sizeof(name), "job-%i", lastJob != NULL ? lastJob->id + 1 : 1);
+        dir = groupPath(name);
+        if (dir != NULL) {
+            configureGroup(dir, jobSettings);
+        }
+    }
+    if (dir != NULL && writeGroupFile(dir, "cgroup.procs", "0") == -1) {
+        printf("cgroup: %s: %s\n", dir, strerror(errno));
+        flushOutput();
+        free(dir);
+        dir = NULL;
+    }
+    return dir;
+};
+
+/*********************************************************
+* cgroupCommand(): Function to run the cgroup built-in   *
+*                  command. With no argument, it lists   *
+*                  the groups, their settings and what   *
+*                  they used. cgroup name file=value...  *
+*                  makes the group name and applies the  *
+*                  settings to it, cgroup -r name...     *
+*                  removes groups, and cgroup -j         *
+*                  file=value... gives every background  *
+*                  job from now on a new group with      *
+*                  these settings (-j off stops it).     *
+*                  cgroup -e is run by                   *
+*                  buildInCommands().                    *
+*********************************************************/
+void cgroupCommand(char* args[SIZE]) {
+
+    static char* files[] = {"cpu.weight", "memory.max", "io.max", NULL};
+    char text[4096];
+    char path[PATH_MAX];
+    struct dirent* entry;
+    DIR* dir;
+    char* group;
+    int numSettings;
+    int i;
+
+    if (setupCgroups() == -1) {
+        status = 256;   // exit value 1.
+        return;
+    }
+    status = 0;
+    if (args[1] == NULL) {
+        if (readGroupFile(cgroupTop, "cgroup.subtree_control", text, sizeof(text)) == 0) {
+            text[strcspn(text, "\n")] = '\0';
+            printf("controllers: %s\n", text[0] != '\0' ? text : "none");
+        }
+        if (jobSettings != NULL) {
+            printf("jobs:");
+            for (i = 0; jobSettings[i] != NULL; i++) {
+                printf(" %s", jobSettings[i]);
+            }
+            printf("\n");
+        }
+        dir = opendir(cgroupTop);
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            if (entry->d_type != DT_DIR || entry->d_name[0] == '.' || strcmp(entry->d_name, "shell") == 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", cgroupTop, entry->d_name);
+            printf("%s:", entry->d_name);
+            for (i = 0; files[i] != NULL; i++) {
+                if (readGroupFile(path, files[i], text, sizeof(text)) == 0 && text[0] != '\0') {
+                    text[strcspn(text, "\n")] = '\0';
+                    printf(" %s=%s", files[i], text);
+                }
+            }
+            printf(" (");
+            printGroupUsage(path);
+            printf(")\n");
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+    } else if (strcmp(args[1], "-r") == 0) {
+        for (i = 2; args[i] != NULL; i++) {
+            snprintf(path, sizeof(path), "%s/%s", cgroupTop, args[i]);
+            if (strchr(args[i], '/') != NULL || args[i][0] == '.' || strcmp(args[i], "shell") == 0) {
+                printf("cgroup: %s: invalid name\n", args[i]);
+                status = 256;   // exit value 1.
+            } else if (rmdir(path) == -1) {
+                printf("cgroup: cannot remove %s: %s\n", args[i], strerror(errno));
+                status = 256;   // exit value 1.
+            }
+        }
+    } else if (strcmp(args[1], "-j") == 0) {
+        for (i = 0; jobSettings != NULL && jobSettings[i] != NULL; i++) {
+            free(jobSettings[i]);
+        }
+        free(jobSettings);
+        jobSettings = NULL;
+        if (args[2] != NULL && strcmp(args[2], "off") != 0) {
+            for (numSettings = 0; args[2 + numSettings] != NULL; numSettings++) {
+                continue;
+            }
+            jobSettings = calloc(numSettings + 1, sizeof(char*));
+            for (i = 0; jobSettings != NULL && i < numSettings; i++) {
+                jobSettings[i] = strdup(args[2 + i]);
+            }
+        }
+    } else if (strchr(args[1], '/') != NULL || args[1][0] == '.' || args[1][0] == '-'
+               || strcmp(args[1], "shell") == 0) {
+        printf("Usage: cgroup [name [file=value...] | -r name... | -j [file=value... | off] | -e name command]\n");
+        status = 256;   // exit value 1.
+    } else if ((group = groupPath(args[1])) != NULL) {
+        if (configureGroup(group, &args[2]) == -1) {
+            status = 256;   // exit value 1.
+        }
+        free(group);
+    } else {
+        status = 256;   // exit value 1.
+    }
+    flushOutput();
+};
+
+/*************************************************************
+* main(): Function to call all functions an run the shell.   *
+*************************************************************/
+int main(int argc, char **argv) {
+
+    // Set local main variables.
+    char* args[SIZE];   // array to store input arguments
+    char* input;        // store user input.
+    int isFore;         // flag to identify foreground or background process.
+    int key = 1;        // Loop key
+    int option;
+    sigset_t childSignals;  // SIGCHLD.
+
+    // Read the options: -e stops at the first failure, -t names
+    // the file to log the usage of every command to, -c gives the
+    // commands to run, and an argument left is the script file.
+    while ((option = getopt(argc, argv, "+ec:t:")) != -1) {
+        if (option == 'e') {
+            stopOnError = 1;
+        } else if (option == 't') {
+            logFile = fopen(optarg, "ae");
+            if (logFile == NULL) {
+                fprintf(stderr, "%s: %s: %s\n", argv[0], optarg, strerror(errno));
+                return 2;
+            }
+            // Name the fields at the top of a new log.
+            if (ftell(logFile) == 0) {
+                fprintf(logFile, "#real\tuser\tsys\tmaxrss\tvcsw\tivcsw\tminflt\tmajflt\tstatus\tcommand\n");
+            }
+        } else if (option == 'c') {
+            script = optarg;
+            scriptSize = strlen(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-e] [-t file] [script | -c commands]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc && (script != NULL || optind + 1 < argc)) {
+        fprintf(stderr, "Usage: %s [-e] [-t file] [script | -c commands]\n", argv[0]);
+        return 2;
+    }
+    if (optind < argc && loadScript(argv[optind]) == -1) {
+        fprintf(stderr, "%s: %s: %s\n", argv[0], argv[optind], strerror(errno));
+        return 127;
+    }
+ 
+    //set up the signal handler behavior. Code model taken from:
+    //https://www.gnu.org/software/libc/manual/html_node/Sigaction-Function-Example.html
+    // Make signals can be ignored.
+    action.sa_handler = SIG_IGN;
+    // Make no flags interrupt the shell execution.
+    action.sa_flags = 0;
+    // Make no signals interrupt the shell execution.
+    sigfillset(&(action.sa_mask));
+    sigaction(SIGINT, &action, NULL);
+
+    // At a terminal, the shell controls the jobs: wait to be in
+    // the foreground, then lead a process group of its own, which
+    // the terminal stops and the jobs can't. A job in the
+    // foreground gets the terminal, and it comes back after.
+    interactive = script == NULL && isatty(0);
+    if (interactive) {
+        while (tcgetpgrp(0) != getpgrp()) {
+            kill(-getpgrp(), SIGTTIN);
+        }
+        sigaction(SIGTSTP, &action, NULL);
+        sigaction(SIGTTIN, &action, NULL);
+        sigaction(SIGTTOU, &action, NULL);
+        setpgid(0, 0);
+        shellGroup = getpgrp();
+        tcsetpgrp(0, shellGroup);
+    }
+
+    // Block SIGCHLD and read it from a signalfd instead, so the
+    // children are only waited for when one of them changed state.
+    sigemptyset(&childSignals);
+    sigaddset(&childSignals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignals, NULL);
+    sigchldFd = signalfd(-1, &childSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    // Read a terminal one byte at a time, or lines buffered in
+    // stdin would be missed while polling for the next one. A
+    // script leaves stdin alone, to the commands it runs, and
+    // fills a large output buffer even at a terminal.
+    if (script != NULL) {
+        setvbuf(stdout, NULL, _IOFBF, 65536);
+    } else if (interactive) {
+        setvbuf(stdin, NULL, _IONBF, 0);
+    }
+    
+    // Main command loop.
+    do {
+        // The default action is to take all
+        // processes as foreground processes.
+        isFore = 1;
+
+        // Print constant prompt. A script gets none.
+        if (script == NULL) {
+            printf(": ");
+        }
+        
+        // Clean prompt using fflush to eliminate garbage from buffer.
+        flushOutput();
+        
+        // Get user input. The end of the input works like exit.
+        input = read_input();
+        if (input == NULL) {
+            killProcess();
+            key = 0;
+
+        // Tokenize Input.
+        } else {
+            tokenize(input, args, isFore);
+
+            // With -e, a failure works like exit.
+            if (stopOnError && status != 0) {
+                killProcess();
+                key = 0;
+            }
+        }
+    } while (key == 1); //Loop conditional.
+    
+    // Exit with the status of the last command, as sh does.
+    fflush(stdout);
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return 128 + WTERMSIG(status); //End main.
+};